@@ -0,0 +1,207 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT bake
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_bake.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "miniRT_light.h"
+#include "miniRT_light_class.h"
+#include "miniRT_new.h"
+#include "miniRT_triangle.h"
+#include "miniRT_vertex_buffer.h"
+
+namespace miniRT {
+
+namespace {
+// maximum lattice resolution of a triangle
+const int max_res = 256;
+
+// first sample of the row a of a lattice of resolution r
+inline int row(int a, int r) { return a * (r + 1) - a * (a - 1) / 2; }
+}  // namespace
+
+light_bake::light_bake()
+    : ntri(0),
+      nlight(0),
+      pres(0),
+      pstart(0),
+      pirr(0),
+      pvis(0),
+      texel(0.0f),
+      light_version(-1),
+      scene_version(-1),
+      valid(false) {}
+
+light_bake::~light_bake() {
+  if (pres) delete[] pres;
+  if (pstart) delete[] pstart;
+  if (pirr) delete[] pirr;
+  if (pvis) delete[] pvis;
+}
+
+bool light_bake::update(triangle* tri, vertex_buffer* pvb,
+                        const light_classifier* plc, const light* pl,
+                        int lcount, float t, int lv, int sv) {
+  assert(tri);
+  assert(pvb);
+  assert(plc);
+  assert(t > 0.0f);
+  if (valid && (t == texel) && (lv == light_version) && (sv == scene_version))
+    return false;
+  texel = t;
+  light_version = lv;
+  scene_version = sv;
+  if (pres) delete[] pres;
+  if (pstart) delete[] pstart;
+  if (pirr) delete[] pirr;
+  if (pvis) delete[] pvis;
+  ntri = tri->size();
+  nlight = lcount;
+  pres = new int[ntri];
+  pstart = new int[ntri + 1];
+  assert(pres);
+  assert(pstart);
+  // lattice resolution from the longest edge
+  int n = 0;
+  for (int i = 0; i < ntri; ++i) {
+    const tri_record& r = tri->get_record(i);
+    float edge = std::max(glm::length(r.edge1),
+                          std::max(glm::length(r.edge2),
+                                   glm::length(r.edge2 - r.edge1)));
+    int res = (int)ceilf(edge / texel);
+    pres[i] = std::min(std::max(res, 1), max_res);
+    pstart[i] = n;
+    n += row(pres[i] + 1, pres[i]);
+  }
+  pstart[ntri] = n;
+  pirr = new float[n * 3];
+  pvis = new float[n * (nlight ? nlight : 1)];
+  assert(pirr);
+  assert(pvis);
+  std::atomic<int> next(0);
+  int nthread = std::max(1, (int)std::thread::hardware_concurrency());
+  std::vector<std::thread> workers;
+  for (int w = 0; w < nthread; ++w)
+    workers.push_back(std::thread(&light_bake::bake_triangles, this, tri, pvb,
+                                  plc, pl, &next));
+  for (int w = 0; w < nthread; ++w) workers[w].join();
+  valid = true;
+  return true;
+}
+
+void light_bake::bake_triangles(triangle* tri, vertex_buffer* pvb,
+                                const light_classifier* plc,
+                                const light* pl, std::atomic<int>* next) {
+  const float eps = std::numeric_limits<float>::epsilon();
+  for (int i = (*next)++; i < ntri; i = (*next)++) {
+    const tri_record& r = tri->get_record(i);
+    glm::vec3 n0 = pvb->get_normal(r.vi[0]);
+    glm::vec3 n1 = pvb->get_normal(r.vi[1]);
+    glm::vec3 n2 = pvb->get_normal(r.vi[2]);
+    int res = pres[i];
+    int s = pstart[i];
+    for (int a = 0; a <= res; ++a) {
+      for (int b = 0; b <= res - a; ++b, ++s) {
+        // same point and normal as phong at these coordinates
+        float u = (float)a / (float)res;
+        float v = (float)b / (float)res;
+        float w = 1.0f - u - v;
+        glm::vec3 p = r.v0 + r.edge1 * u + r.edge2 * v;
+        glm::vec3 n = n0 * w + n1 * u + n2 * v;
+        glm::vec3 irr(0.0f);
+        for (int j = 0; j < nlight; ++j) {
+          glm::vec3 lpos = pl[j].position();
+          glm::vec3 l = glm::normalize(lpos - p);
+          float ndl = glm::dot(n, l);
+          float vis = (ndl >= eps) ? 1.0f : 0.0f;
+          light_class c = plc->get(j, i);
+          if (c == class_unlit) vis = 0.0f;
+          if ((vis != 0.0f) && (c == class_partial)) {
+            float tmax = glm::length(lpos - p) - eps;
+            int nc;
+            const int* pc = plc->candidates(j, i, &nc);
+            for (int k = 0; k < nc; ++k) {
+              if (tri->shadow_hit(pc[k], p, l, eps, tmax)) {
+                vis = 0.0f;
+                break;
+              }
+            }
+          }
+          glm::vec4 amb = pl[j].ambiant();
+          glm::vec4 diff = pl[j].diffuse();
+          float att = pl[j].attenuation(glm::dot(lpos - p, lpos - p));
+          irr += glm::vec3(amb.x, amb.y, amb.z) +
+                 glm::vec3(diff.x, diff.y, diff.z) * (vis * att * ndl);
+          pvis[s * nlight + j] = vis;
+        }
+        pirr[s * 3] = irr.x;
+        pirr[s * 3 + 1] = irr.y;
+        pirr[s * 3 + 2] = irr.z;
+      }
+    }
+  }
+}
+
+void light_bake::corners(int i, float u, float v, int* s, float* w) const {
+  int res = pres[i];
+  float x = std::min(std::max(u, 0.0f), 1.0f) * (float)res;
+  float y = std::min(std::max(v, 0.0f), 1.0f) * (float)res;
+  int a = std::min((int)x, res - 1);
+  int b = std::min((int)y, res - 1 - a);
+  if (b < 0) b = 0;
+  float fx = x - (float)a;
+  float fy = y - (float)b;
+  int base = pstart[i];
+  if ((fx + fy <= 1.0f) || (a + b + 2 > res)) {
+    // lower cell (a, b), (a + 1, b), (a, b + 1)
+    s[0] = base + row(a, res) + b;
+    s[1] = base + row(a + 1, res) + b;
+    s[2] = base + row(a, res) + b + 1;
+    w[0] = 1.0f - fx - fy;
+    w[1] = fx;
+    w[2] = fy;
+  } else {
+    // upper cell (a + 1, b + 1), (a, b + 1), (a + 1, b)
+    s[0] = base + row(a + 1, res) + b + 1;
+    s[1] = base + row(a, res) + b + 1;
+    s[2] = base + row(a + 1, res) + b;
+    w[0] = fx + fy - 1.0f;
+    w[1] = 1.0f - fx;
+    w[2] = 1.0f - fy;
+  }
+}
+
+glm::vec3 light_bake::irradiance(int i, float u, float v) const {
+  assert(valid);
+  int s[3];
+  float w[3];
+  corners(i, u, v, s, w);
+  glm::vec3 irr(0.0f);
+  for (int c = 0; c < 3; ++c)
+    irr += glm::vec3(pirr[s[c] * 3], pirr[s[c] * 3 + 1], pirr[s[c] * 3 + 2]) *
+           w[c];
+  return irr;
+}
+
+float light_bake::visibility(int j, int i, float u, float v) const {
+  assert(valid);
+  int s[3];
+  float w[3];
+  corners(i, u, v, s, w);
+  return pvis[s[0] * nlight + j] * w[0] + pvis[s[1] * nlight + j] * w[1] +
+         pvis[s[2] * nlight + j] * w[2];
+}
+
+}  // end namespace miniRT
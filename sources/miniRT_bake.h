@@ -0,0 +1,63 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT bake (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// view independent lighting (ambiant + diffuse) and visibility of
+// every light baked on a lattice of samples per triangle (barycentric
+// steps of 1 / res, res from the triangle size and the texel size).
+// valid as long as the lights and the geometry do not move.
+
+#ifndef __MINIRT_BAKE_DEFINED__
+#define __MINIRT_BAKE_DEFINED__
+
+#include <atomic>
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class triangle;
+class vertex_buffer;
+class light;
+class light_classifier;
+
+class light_bake {
+  int ntri;
+  int nlight;
+  // lattice resolution and first sample per triangle
+  int* pres;
+  int* pstart;
+  // (ambiant + diffuse) rgb and visibility per light of each sample
+  float* pirr;
+  float* pvis;
+  float texel;
+  int light_version;
+  int scene_version;
+  bool valid;
+  void bake_triangles(triangle* tri, vertex_buffer* pvb,
+                      const light_classifier* plc, const light* pl,
+                      std::atomic<int>* next);
+  // the 3 samples around (u, v) on the triangle i and their weights
+  void corners(int i, float u, float v, int* s, float* w) const;
+
+ public:
+  light_bake();
+  ~light_bake();
+  // rebake (multithreaded) if the lights, the geometry (render versions)
+  // or the texel size t changed, the classifier must be up to date,
+  // return true if the bake was redone
+  bool update(triangle* tri, vertex_buffer* pvb,
+              const light_classifier* plc, const light* pl, int lcount,
+              float t, int lv, int sv);
+  // force a rebake at next update
+  void invalidate() { valid = false; }
+  // interpolated values at the barycentric coordinates (u, v) of the
+  // triangle i
+  glm::vec3 irradiance(int i, float u, float v) const;
+  float visibility(int j, int i, float u, float v) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_BAKE_DEFINED__
@@ -0,0 +1,172 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT bc1
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_bc1.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "miniRT_simd.h"
+
+namespace miniRT {
+
+// RGB565 to 0x00bbggrr (the high bits are repeated in the low ones)
+static unsigned int expand565(unsigned int c) {
+  unsigned int r = (c >> 11) & 31;
+  unsigned int g = (c >> 5) & 63;
+  unsigned int b = c & 31;
+  r = (r << 3) | (r >> 2);
+  g = (g << 2) | (g >> 4);
+  b = (b << 3) | (b >> 2);
+  return r | (g << 8) | (b << 16);
+}
+
+static unsigned int quantize(float v, int bits) {
+  float m = (float)((1 << bits) - 1);
+  float q = v * m / 255.0f + 0.5f;
+  if (q < 0.0f) return 0;
+  if (q > m) return (unsigned int)m;
+  return (unsigned int)q;
+}
+
+static unsigned int pack565(const float* c) {
+  return (quantize(c[0], 5) << 11) | (quantize(c[1], 6) << 5) |
+         quantize(c[2], 5);
+}
+
+void bc1_encode(const unsigned int* texel, unsigned int* block) {
+  assert(texel);
+  assert(block);
+  float c[16][3];
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  float lo[3] = {255.0f, 255.0f, 255.0f};
+  float hi[3] = {0.0f, 0.0f, 0.0f};
+  for (int i = 0; i < 16; ++i) {
+    for (int e = 0; e < 3; ++e) {
+      c[i][e] = (float)((texel[i] >> (e * 8)) & 0xff);
+      mean[e] += c[i][e] * (1.0f / 16.0f);
+      lo[e] = std::min(lo[e], c[i][e]);
+      hi[e] = std::max(hi[e], c[i][e]);
+    }
+  }
+  // covariance
+  float cov[3][3] = {{0.0f}};
+  for (int i = 0; i < 16; ++i)
+    for (int e = 0; e < 3; ++e)
+      for (int f = 0; f < 3; ++f)
+        cov[e][f] += (c[i][e] - mean[e]) * (c[i][f] - mean[f]);
+  // principal axis (power iterations from the box diagonal)
+  float axis[3] = {hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2]};
+  for (int it = 0; it < 4; ++it) {
+    float a[3];
+    for (int e = 0; e < 3; ++e)
+      a[e] = cov[e][0] * axis[0] + cov[e][1] * axis[1] + cov[e][2] * axis[2];
+    float len = sqrtf(a[0] * a[0] + a[1] * a[1] + a[2] * a[2]);
+    if (len <= 0.0f) break;
+    for (int e = 0; e < 3; ++e) axis[e] = a[e] / len;
+  }
+  float len2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+  float tmin = 0.0f;
+  float tmax = 0.0f;
+  if (len2 > 0.0f) {
+    for (int e = 0; e < 3; ++e) axis[e] /= sqrtf(len2);
+    for (int i = 0; i < 16; ++i) {
+      float t = 0.0f;
+      for (int e = 0; e < 3; ++e) t += (c[i][e] - mean[e]) * axis[e];
+      tmin = std::min(tmin, t);
+      tmax = std::max(tmax, t);
+    }
+  }
+  // end points on the axis
+  float e0[3];
+  float e1[3];
+  for (int e = 0; e < 3; ++e) {
+    e0[e] = mean[e] + axis[e] * tmax;
+    e1[e] = mean[e] + axis[e] * tmin;
+  }
+  unsigned int c0 = pack565(e0);
+  unsigned int c1 = pack565(e1);
+  // c0 > c1 selects the 4 colours palette
+  if (c0 < c1) {
+    unsigned int t = c0;
+    c0 = c1;
+    c1 = t;
+  }
+  block[0] = c0 | (c1 << 16);
+  block[1] = 0;
+  if (c0 == c1) return;
+  // nearest colour of the palette
+  unsigned int palette[4];
+  bc1_palette(block, palette);
+  for (int i = 0; i < 16; ++i) {
+    int best = 0;
+    float dbest = 0.0f;
+    for (int p = 0; p < 4; ++p) {
+      float d = 0.0f;
+      for (int e = 0; e < 3; ++e) {
+        float v = (float)((palette[p] >> (e * 8)) & 0xff) - c[i][e];
+        d += v * v;
+      }
+      if (!p || (d < dbest)) {
+        best = p;
+        dbest = d;
+      }
+    }
+    block[1] |= (unsigned int)best << (i * 2);
+  }
+}
+
+void bc1_palette(const unsigned int* block, unsigned int* palette) {
+  unsigned int c0 = block[0] & 0xffff;
+  unsigned int c1 = block[0] >> 16;
+  unsigned int p0 = expand565(c0);
+  unsigned int p1 = expand565(c1);
+  palette[0] = p0;
+  palette[1] = p1;
+  if (c0 <= c1) {
+    // 3 colours and black
+    unsigned int m = 0;
+    for (int e = 0; e < 24; e += 8)
+      m |= ((((p0 >> e) & 0xff) + ((p1 >> e) & 0xff)) / 2) << e;
+    palette[2] = m;
+    palette[3] = 0;
+    return;
+  }
+#ifdef MINIRT_SSE
+  // (2 p0 + p1) / 3 and (p0 + 2 p1) / 3 on 16 bits lanes, the
+  // division is a multiply by 65536 / 3 (exact for these values)
+  __m128i zero = _mm_setzero_si128();
+  __m128i a = _mm_unpacklo_epi8(_mm_set1_epi32((int)p0), zero);
+  __m128i b = _mm_unpacklo_epi8(_mm_set1_epi32((int)p1), zero);
+  __m128i s = _mm_add_epi16(_mm_add_epi16(a, b), _mm_unpacklo_epi64(a, b));
+  s = _mm_packus_epi16(_mm_mulhi_epu16(s, _mm_set1_epi16(21846)), zero);
+  palette[2] = (unsigned int)_mm_cvtsi128_si32(s);
+  palette[3] = (unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(s, 4));
+#else
+  unsigned int m2 = 0;
+  unsigned int m3 = 0;
+  for (int e = 0; e < 24; e += 8) {
+    unsigned int a = (p0 >> e) & 0xff;
+    unsigned int b = (p1 >> e) & 0xff;
+    m2 |= ((2 * a + b) / 3) << e;
+    m3 |= ((a + 2 * b) / 3) << e;
+  }
+  palette[2] = m2;
+  palette[3] = m3;
+#endif  // MINIRT_SSE
+}
+
+void bc1_decode(const unsigned int* block, unsigned int* texel) {
+  unsigned int palette[4];
+  bc1_palette(block, palette);
+  unsigned int bits = block[1];
+  for (int i = 0; i < 16; ++i, bits >>= 2) texel[i] = palette[bits & 3];
+}
+
+}  // end namespace miniRT
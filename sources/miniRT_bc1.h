@@ -0,0 +1,36 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT bc1 (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// BC1 (DXT1) blocks : 4x4 texels in 8 bytes, 2 RGB565 end points and
+// 2 bits per texel choosing one of the 4 colours of the palette
+// (the end points and 2 points in between). texels are 0x00bbggrr
+// and stored row by row, texel i of the block is the bits 2i of the
+// second word.
+
+#ifndef __MINIRT_BC1_DEFINED__
+#define __MINIRT_BC1_DEFINED__
+
+namespace miniRT {
+
+// words per block
+const int bc1_block_size = 2;
+
+// compress the 16 texels (principal axis end points, nearest colour)
+void bc1_encode(const unsigned int* texel, unsigned int* block);
+// the 4 colours of the block
+void bc1_palette(const unsigned int* block, unsigned int* palette);
+// the 16 texels of the block
+void bc1_decode(const unsigned int* block, unsigned int* texel);
+// texel i of the block
+inline unsigned int bc1_texel(const unsigned int* block, int i) {
+  unsigned int palette[4];
+  bc1_palette(block, palette);
+  return palette[(block[1] >> (i * 2)) & 3];
+}
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_BC1_DEFINED__
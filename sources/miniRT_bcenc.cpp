@@ -0,0 +1,95 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT bc encoder
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// offline tool : compress a binary PPM (P6, power of 2 sizes) and its
+// mip levels to BC1 blocks, the result is loaded by texture::load.
+//   minirt_bcenc input.ppm output.bct
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "miniRT_texture.h"
+
+using namespace miniRT;
+
+// next header value of the PPM (skip the spaces and the comments)
+static int read_value(FILE* f) {
+  int c = fgetc(f);
+  while ((c == ' ') || (c == '\t') || (c == '\r') || (c == '\n') ||
+         (c == '#')) {
+    if (c == '#')
+      while ((c != '\n') && (c != EOF)) c = fgetc(f);
+    c = fgetc(f);
+  }
+  int v = 0;
+  if ((c < '0') || (c > '9')) return -1;
+  while ((c >= '0') && (c <= '9')) {
+    v = v * 10 + (c - '0');
+    c = fgetc(f);
+  }
+  return v;
+}
+
+// w * h texels as 0x00bbggrr, 0 if it failed
+static unsigned int* read_ppm(const char* name, int* w, int* h) {
+  FILE* f = fopen(name, "rb");
+  if (!f) return 0;
+  if ((fgetc(f) != 'P') || (fgetc(f) != '6')) {
+    fclose(f);
+    return 0;
+  }
+  *w = read_value(f);
+  *h = read_value(f);
+  int maxv = read_value(f);
+  // (the texel count must fit in an int)
+  if ((*w <= 0) || (*h <= 0) || (*w > max_texture_size) ||
+      (*h > max_texture_size) || (maxv != 255)) {
+    fclose(f);
+    return 0;
+  }
+  unsigned int* rgba = new unsigned int[*w * *h];
+  for (int i = 0; i < *w * *h; ++i) {
+    unsigned char c[3];
+    if (fread(c, 1, 3, f) != 3) {
+      delete[] rgba;
+      fclose(f);
+      return 0;
+    }
+    rgba[i] = c[0] | (c[1] << 8) | (c[2] << 16);
+  }
+  fclose(f);
+  return rgba;
+}
+
+int main(int ac, char** av) {
+  if (ac != 3) {
+    fprintf(stderr, "usage : %s input.ppm output.bct\n", av[0]);
+    return 1;
+  }
+  int w, h;
+  unsigned int* rgba = read_ppm(av[1], &w, &h);
+  if (!rgba) {
+    fprintf(stderr, "can't read %s (binary PPM, 8 bits, up to %d x %d)\n",
+            av[1], max_texture_size, max_texture_size);
+    return 1;
+  }
+  if (!texture::valid_size(w, h)) {
+    fprintf(stderr, "%s is %d x %d, sizes must be powers of 2\n", av[1], w,
+            h);
+    delete[] rgba;
+    return 1;
+  }
+  texture full(w, h, rgba);
+  texture bc(w, h, rgba, true);
+  delete[] rgba;
+  if (!bc.save(av[2])) {
+    fprintf(stderr, "can't write %s\n", av[2]);
+    return 1;
+  }
+  printf("%s : %d x %d, %d levels, %d bytes -> %d bytes\n", av[2], w, h,
+         bc.levels(), full.bytes(), bc.bytes());
+  return 0;
+}
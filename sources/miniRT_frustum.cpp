@@ -0,0 +1,110 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT frustum
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_frustum.h"
+
+#include <assert.h>
+
+#include <cmath>
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+namespace {
+// slack so that rays lying on a plane are never culled
+const float plane_epsilon = 1e-5f;
+}  // namespace
+
+frustum::frustum(glm::vec3 o, glm::vec3 c0, glm::vec3 c1, glm::vec3 c2,
+                 glm::vec3 c3)
+    : nb(0) {
+  glm::vec3 c[4] = {c0, c1, c2, c3};
+  glm::vec3 center = c0 + c1 + c2 + c3;
+  for (int i = 0; i < 4; ++i) {
+    glm::vec3 n = glm::cross(c[i], c[(i + 1) % 4]);
+    if (glm::dot(n, center) < 0.0f) n = -n;
+    add_plane(n, o);
+  }
+}
+
+frustum::frustum(glm::vec3 l, glm::vec3 bmin, glm::vec3 bmax) : nb(0) {
+  // box around the light and the receivers
+  glm::vec3 lmin = glm::min(l, bmin);
+  glm::vec3 lmax = glm::max(l, bmax);
+  add_plane(glm::vec3(1.0f, 0.0f, 0.0f), lmin);
+  add_plane(glm::vec3(0.0f, 1.0f, 0.0f), lmin);
+  add_plane(glm::vec3(0.0f, 0.0f, 1.0f), lmin);
+  add_plane(glm::vec3(-1.0f, 0.0f, 0.0f), lmax);
+  add_plane(glm::vec3(0.0f, -1.0f, 0.0f), lmax);
+  add_plane(glm::vec3(0.0f, 0.0f, -1.0f), lmax);
+  // side planes from the light, only if the box is in front of it
+  glm::vec3 a = (bmin + bmax) * 0.5f - l;
+  if (glm::dot(a, a) <= plane_epsilon) return;
+  a = glm::normalize(a);
+  glm::vec3 b1 = glm::cross(a, glm::vec3(0.0f, 1.0f, 0.0f));
+  if (glm::dot(b1, b1) < 0.01f)
+    b1 = glm::cross(a, glm::vec3(1.0f, 0.0f, 0.0f));
+  b1 = glm::normalize(b1);
+  glm::vec3 b2 = glm::cross(a, b1);
+  float min1 = std::numeric_limits<float>::max();
+  float max1 = -std::numeric_limits<float>::max();
+  float min2 = std::numeric_limits<float>::max();
+  float max2 = -std::numeric_limits<float>::max();
+  for (int i = 0; i < 8; ++i) {
+    glm::vec3 q((i & 1) ? bmax.x : bmin.x, (i & 2) ? bmax.y : bmin.y,
+                (i & 4) ? bmax.z : bmin.z);
+    q -= l;
+    float s = glm::dot(q, a);
+    if (s <= plane_epsilon) return;
+    float s1 = glm::dot(q, b1) / s;
+    float s2 = glm::dot(q, b2) / s;
+    if (s1 < min1) min1 = s1;
+    if (s1 > max1) max1 = s1;
+    if (s2 < min2) min2 = s2;
+    if (s2 > max2) max2 = s2;
+  }
+  add_plane(a * max1 - b1, l);
+  add_plane(b1 - a * min1, l);
+  add_plane(a * max2 - b2, l);
+  add_plane(b2 - a * min2, l);
+}
+
+void frustum::add_plane(glm::vec3 n, glm::vec3 p) {
+  assert(nb < max_plane);
+  float len = std::sqrt(glm::dot(n, n));
+  // degenerated (flat tile), cannot cull anything
+  if (len <= std::numeric_limits<float>::epsilon()) return;
+  n *= 1.0f / len;
+  plane[nb++] = glm::vec4(n, -glm::dot(n, p));
+}
+
+bool frustum::cull_box(glm::vec3 bmin, glm::vec3 bmax) const {
+  for (int i = 0; i < nb; ++i) {
+    const glm::vec4& pl = plane[i];
+    // corner the most inside
+    glm::vec3 p((pl.x >= 0.0f) ? bmax.x : bmin.x,
+                (pl.y >= 0.0f) ? bmax.y : bmin.y,
+                (pl.z >= 0.0f) ? bmax.z : bmin.z);
+    if (pl.x * p.x + pl.y * p.y + pl.z * p.z + pl.w < -plane_epsilon)
+      return true;
+  }
+  return false;
+}
+
+bool frustum::cull_triangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) const {
+  for (int i = 0; i < nb; ++i) {
+    glm::vec3 n = plane[i];
+    float d = plane[i].w;
+    if ((glm::dot(n, p0) + d < -plane_epsilon) &&
+        (glm::dot(n, p1) + d < -plane_epsilon) &&
+        (glm::dot(n, p2) + d < -plane_epsilon))
+      return true;
+  }
+  return false;
+}
+
+}  // end namespace miniRT
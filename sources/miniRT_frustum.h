@@ -0,0 +1,41 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT frustum (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// convex volume bounded by planes, used to reject boxes and triangles
+// once for a whole group of coherent rays (a screen tile).
+
+#ifndef __MINIRT_FRUSTUM_DEFINED__
+#define __MINIRT_FRUSTUM_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class frustum {
+  static const int max_plane = 12;
+  // inside is dot(plane, vec4(p, 1)) >= 0
+  glm::vec4 plane[max_plane];
+  int nb;
+
+ public:
+  frustum() : nb(0) {}
+  // rays from o going through the 4 corner directions (in turning order)
+  frustum(glm::vec3 o, glm::vec3 c0, glm::vec3 c1, glm::vec3 c2,
+          glm::vec3 c3);
+  // segments from the point l to the box [bmin, bmax] (shadow beam)
+  frustum(glm::vec3 l, glm::vec3 bmin, glm::vec3 bmax);
+  // add a plane going through p with the inside toward n
+  void add_plane(glm::vec3 n, glm::vec3 p);
+  int size() const { return nb; }
+  // true if the box is completely outside
+  bool cull_box(glm::vec3 bmin, glm::vec3 bmax) const;
+  // true if the triangle is completely outside
+  bool cull_triangle(glm::vec3 p0, glm::vec3 p1, glm::vec3 p2) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_FRUSTUM_DEFINED__
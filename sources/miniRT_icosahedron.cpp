@@ -11,51 +11,59 @@ namespace miniRT {
 
 icosahedron::icosahedron() {
   const vertex vb[] = {
-      vertex(vector3(1.0f, 2.701302f, -0.051462f),
-             vector3(1.0f, 2.701302f, -0.051462f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(1.0f, -0.701302f, -0.051462f),
-             vector3(1.0f, -0.701302f, -0.051462f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(2.051462f, 1.0f, 2.701302f),
-             vector3(2.051462f, 1.0f, 2.701302f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(2.051462f, 1.0f, -0.701302f),
-             vector3(2.051462f, 1.0f, -0.701302f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(-0.051462f, 1.0f, 2.701302f),
-             vector3(-0.051462f, 1.0f, 2.701302f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(-0.051462f, 1.0f, -0.701302f),
-             vector3(-0.051462f, 1.0f, -0.701302f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(2.701302f, 2.051462f, 1.0f),
-             vector3(2.701302f, 2.051462f, 1.0f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(2.701302f, -0.051462f, 1.0f),
-             vector3(2.701302f, -0.051462f, 1.0f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(-0.701302f, 2.051462f, 1.0f),
-             vector3(-0.701302f, 2.051462f, 1.0f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(-0.701302f, -0.051462f, 1.0f),
-             vector3(-0.701302f, -0.051462f, 1.0f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(1.0f, 2.701302f, 2.051462f),
-             vector3(1.0f, 2.701302f, 2.051462f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
-      vertex(vector3(1.0f, -0.701302f, 2.051462f),
-             vector3(1.0f, -0.701302f, 2.051462f).Normalize(),
-             vector4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(1.0f, 2.701302f, -0.051462f),
+             glm::normalize(glm::vec3(1.0f, 2.701302f, -0.051462f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(1.0f, -0.701302f, -0.051462f),
+             glm::normalize(glm::vec3(1.0f, -0.701302f, -0.051462f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(2.051462f, 1.0f, 2.701302f),
+             glm::normalize(glm::vec3(2.051462f, 1.0f, 2.701302f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(2.051462f, 1.0f, -0.701302f),
+             glm::normalize(glm::vec3(2.051462f, 1.0f, -0.701302f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(-0.051462f, 1.0f, 2.701302f),
+             glm::normalize(glm::vec3(-0.051462f, 1.0f, 2.701302f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(-0.051462f, 1.0f, -0.701302f),
+             glm::normalize(glm::vec3(-0.051462f, 1.0f, -0.701302f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(2.701302f, 2.051462f, 1.0f),
+             glm::normalize(glm::vec3(2.701302f, 2.051462f, 1.0f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(2.701302f, -0.051462f, 1.0f),
+             glm::normalize(glm::vec3(2.701302f, -0.051462f, 1.0f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(-0.701302f, 2.051462f, 1.0f),
+             glm::normalize(glm::vec3(-0.701302f, 2.051462f, 1.0f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(-0.701302f, -0.051462f, 1.0f),
+             glm::normalize(glm::vec3(-0.701302f, -0.051462f, 1.0f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(1.0f, 2.701302f, 2.051462f),
+             glm::normalize(glm::vec3(1.0f, 2.701302f, 2.051462f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
+      vertex(glm::vec3(1.0f, -0.701302f, 2.051462f),
+             glm::normalize(glm::vec3(1.0f, -0.701302f, 2.051462f)),
+             glm::vec4(0.0f, 1.0f, 1.0f, 1.0f)),
       // plane
-      vertex(vector3(-10.0f, -2.0f, -10.0f),
-             vector3(0.0f, 1.0f, 0.0f).Normalize(), vector4(1.0f, 1.0f, 0.0f)),
-      vertex(vector3(10.0f, -2.0f, -10.0f),
-             vector3(0.0f, 1.0f, 0.0f).Normalize(), vector4(1.0f, 1.0f, 0.0f)),
-      vertex(vector3(10.0f, -2.0f, 10.0f),
-             vector3(0.0f, 1.0f, 0.0f).Normalize(), vector4(1.0f, 1.0f, 0.0f)),
-      vertex(vector3(-10.0f, -2.0f, 10.0f),
-             vector3(0.0f, 1.0f, 0.0f).Normalize(), vector4(1.0f, 1.0f, 0.0f))};
+      vertex(glm::vec3(-10.0f, -2.0f, -10.0f),
+             glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f)),
+             glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+             glm::vec2(0.0f, 0.0f)),
+      vertex(glm::vec3(10.0f, -2.0f, -10.0f),
+             glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f)),
+             glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+             glm::vec2(10.0f, 0.0f)),
+      vertex(glm::vec3(10.0f, -2.0f, 10.0f),
+             glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f)),
+             glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+             glm::vec2(10.0f, 10.0f)),
+      vertex(glm::vec3(-10.0f, -2.0f, 10.0f),
+             glm::normalize(glm::vec3(0.0f, 1.0f, 0.0f)),
+             glm::vec4(1.0f, 1.0f, 0.0f, 1.0f),
+             glm::vec2(0.0f, 10.0f))};
   pvb_ = new vertex_buffer(nbvertex_);
   pvb_->set_optimized(vb);
   const int ib[] = {// icosahedron
@@ -69,8 +77,8 @@ icosahedron::icosahedron() {
 }
 
 icosahedron::~icosahedron() {
-  if (pvb_) delete[] pvb_;
-  if (pib_) delete[] pib_;
+  if (pvb_) delete pvb_;
+  if (pib_) delete pib_;
 }
 
 }  // End namespace miniRT.
\ No newline at end of file
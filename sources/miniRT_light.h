@@ -10,12 +10,23 @@
 
 namespace miniRT {
 
+// how the shadows of a light are computed
+enum shadow_technique {
+  shadow_ray = 0,      // exact shadow rays
+  shadow_map_cube = 1,  // cube depth map from the light (PCF)
+  shadow_sdf = 2        // cone traced in the distance field (soft)
+};
+
 class light {
   glm::vec4 spec;
   glm::vec4 diff;
   glm::vec4 amb;
   glm::vec3 pos;
-  int lh;
+  shadow_technique tech;
+  // size of the light (soft shadows)
+  float rad;
+  // no diffuse and specular past that distance (0 is infinite)
+  float rng;
 
  public:
   light()
@@ -23,13 +34,20 @@ class light {
         spec(glm::vec4(1.0f, 1.0f, 1.0f, 0.0f)),
         diff(glm::vec4(0.5f, 0.5f, 0.5f, 0.0f)),
         amb(glm::vec4(0.2f, 0.2f, 0.2f, 0.0f)),
-        lh(-1) {}
+        tech(shadow_ray),
+        rad(0.0f),
+        rng(0.0f) {}
   light(glm::vec3 p,  // position
         glm::vec4 s,  // specular
         glm::vec4 d,  // diffuse
         glm::vec4 a)  // ambiant
-      : pos(p), spec(s), diff(d), amb(a), lh(-1) {}
-  int last_hit() const { return lh; }
+      : pos(p),
+        spec(s),
+        diff(d),
+        amb(a),
+        tech(shadow_ray),
+        rad(0.0f),
+        rng(0.0f) {}
   glm::vec4 ambiant() const { return amb; }
   glm::vec4 diffuse() const { return diff; }
   glm::vec4 specular() const { return spec; }
@@ -38,7 +56,18 @@ class light {
   glm::vec4 diffuse() { return diff; }
   glm::vec4 specular() { return spec; }
   glm::vec3 position() { return pos; }
-  int& last_hit() { return lh; }
+  shadow_technique technique() const { return tech; }
+  void set_technique(shadow_technique t) { tech = t; }
+  float radius() const { return rad; }
+  void set_radius(float r) { rad = r; }
+  float range() const { return rng; }
+  void set_range(float r) { rng = r; }
+  // smooth falloff (1 - (d / range)^2)^2 at the squared distance d2
+  float attenuation(float d2) const {
+    if (rng <= 0.0f) return 1.0f;
+    float x = 1.0f - d2 / (rng * rng);
+    return (x > 0.0f) ? x * x : 0.0f;
+  }
 };
 
 }  // end of namespace miniRT
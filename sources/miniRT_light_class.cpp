@@ -0,0 +1,114 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT light class
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_light_class.h"
+
+#include <assert.h>
+
+#include <cstring>
+#include <glm/glm.hpp>
+
+#include "miniRT_frustum.h"
+#include "miniRT_light.h"
+#include "miniRT_new.h"
+#include "miniRT_triangle.h"
+#include "miniRT_vertex_buffer.h"
+
+namespace miniRT {
+
+light_classifier::light_classifier()
+    : ntri(0), nlight(0), pclass(0), pstart(0), pocc(0), nocc(0), maxocc(0) {}
+
+light_classifier::~light_classifier() {
+  if (pclass) delete[] pclass;
+  if (pstart) delete[] pstart;
+  if (pocc) delete[] pocc;
+}
+
+void light_classifier::push(int k) {
+  if (nocc == maxocc) {
+    maxocc = maxocc ? maxocc * 2 : 1024;
+    int* temp = new int[maxocc];
+    assert(temp);
+    if (pocc) {
+      memcpy(temp, pocc, sizeof(int) * nocc);
+      delete[] pocc;
+    }
+    pocc = temp;
+  }
+  pocc[nocc++] = k;
+}
+
+void light_classifier::build(triangle* tri, vertex_buffer* pvb,
+                             const glm::vec3* pbox, const glm::vec3* pchunk,
+                             int chunk, const light* pl, int lcount) {
+  assert(tri);
+  assert(pvb);
+  assert(pbox);
+  assert(pchunk);
+  assert(chunk > 0);
+  if (pclass) delete[] pclass;
+  if (pstart) delete[] pstart;
+  ntri = tri->size();
+  nlight = lcount;
+  nocc = 0;
+  pclass = new unsigned char[nlight * ntri];
+  pstart = new int[nlight * ntri + 1];
+  assert(pclass);
+  assert(pstart);
+
+  for (int j = 0; j < nlight; ++j) {
+    glm::vec3 l = pl[j].position();
+    for (int i = 0; i < ntri; ++i) {
+      int c = j * ntri + i;
+      pstart[c] = nocc;
+      const tri_record& r = tri->get_record(i);
+      glm::vec3 p[3] = {r.v0, r.v0 + r.edge1, r.v0 + r.edge2};
+      // N.(L - P) is a sum of n_a.(L - p_b) with positive weights
+      // (barycentric products) so if all of them are negative the
+      // triangle backfaces the light everywhere
+      bool unlit = true;
+      for (int a = 0; a < 3 && unlit; ++a) {
+        glm::vec3 n = pvb->get_normal(r.vi[a]);
+        for (int b = 0; b < 3 && unlit; ++b)
+          if (glm::dot(n, l - p[b]) > 0.0f) unlit = false;
+      }
+      if (unlit) {
+        pclass[c] = class_unlit;
+        continue;
+      }
+      // all the shadow rays are inside the tetrahedron (triangle, light)
+      frustum f;
+      glm::vec3 center = (p[0] + p[1] + p[2] + l) * 0.25f;
+      glm::vec3 face[4][3] = {{p[0], p[1], p[2]},
+                              {p[0], p[1], l},
+                              {p[1], p[2], l},
+                              {p[2], p[0], l}};
+      for (int e = 0; e < 4; ++e) {
+        glm::vec3 n =
+            glm::cross(face[e][1] - face[e][0], face[e][2] - face[e][0]);
+        if (glm::dot(n, center - face[e][0]) < 0.0f) n = -n;
+        f.add_plane(n, face[e][0]);
+      }
+      for (int g = 0; g * chunk < ntri; ++g) {
+        if (f.cull_box(pchunk[g * 2], pchunk[g * 2 + 1])) continue;
+        int glast = (g + 1) * chunk < ntri ? (g + 1) * chunk : ntri;
+        for (int k = g * chunk; k < glast; ++k) {
+          if (k == i) continue;
+          if (f.cull_box(pbox[k * 2], pbox[k * 2 + 1])) continue;
+          const tri_record& o = tri->get_record(k);
+          if (f.cull_triangle(o.v0, o.v0 + o.edge1, o.v0 + o.edge2)) continue;
+          push(k);
+        }
+      }
+      pclass[c] = (nocc == pstart[c]) ? class_lit : class_partial;
+    }
+  }
+  pstart[nlight * ntri] = nocc;
+}
+
+}  // end namespace miniRT
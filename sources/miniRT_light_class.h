@@ -0,0 +1,59 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT light class (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// conservative classification of every triangle for every light :
+// fully lit (nothing can occlude it), fully unlit (backfacing the
+// light everywhere) or potentially shadowed with the list of the only
+// triangles that can occlude it. valid as long as the lights and the
+// geometry do not move.
+
+#ifndef __MINIRT_LIGHT_CLASS_DEFINED__
+#define __MINIRT_LIGHT_CLASS_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class triangle;
+class vertex_buffer;
+class light;
+
+enum light_class { class_lit = 0, class_unlit = 1, class_partial = 2 };
+
+class light_classifier {
+  int ntri;
+  int nlight;
+  // class per [light * ntri + triangle]
+  unsigned char* pclass;
+  // candidate occluders of [light * ntri + triangle] are
+  // pocc[pstart[light * ntri + triangle]] to pocc[pstart[... + 1]]
+  int* pstart;
+  int* pocc;
+  int nocc;
+  int maxocc;
+  void push(int k);
+
+ public:
+  light_classifier();
+  ~light_classifier();
+  // classify the triangles (tri records, boxes and chunk boxes as in
+  // render) for all the lights
+  void build(triangle* tri, vertex_buffer* pvb, const glm::vec3* pbox,
+             const glm::vec3* pchunk, int chunk, const light* pl, int lcount);
+  bool empty() const { return !pclass; }
+  light_class get(int j, int i) const {
+    return (light_class)pclass[j * ntri + i];
+  }
+  const int* candidates(int j, int i, int* n) const {
+    int s = pstart[j * ntri + i];
+    *n = pstart[j * ntri + i + 1] - s;
+    return pocc + s;
+  }
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_LIGHT_CLASS_DEFINED__
@@ -0,0 +1,138 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT light tree
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_light_tree.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <glm/glm.hpp>
+
+#include "miniRT_light.h"
+#include "miniRT_new.h"
+
+namespace miniRT {
+
+light_tree::light_tree() : pn(0), nn(0), maxn(0), pidx(0), pl(0) {}
+
+light_tree::~light_tree() {
+  if (pn) delete[] pn;
+  if (pidx) delete[] pidx;
+}
+
+void light_tree::build(const light* l, int lcount) {
+  assert(l);
+  assert(lcount > 0);
+  pl = l;
+  // a full binary tree has 2 * lcount - 1 nodes
+  if (maxn < 2 * lcount - 1) {
+    if (pn) delete[] pn;
+    if (pidx) delete[] pidx;
+    maxn = 2 * lcount - 1;
+    pn = new node[maxn];
+    pidx = new int[lcount];
+    assert(pn);
+    assert(pidx);
+  }
+  for (int j = 0; j < lcount; ++j) pidx[j] = j;
+  nn = 1;
+  build_node(0, 0, lcount);
+}
+
+void light_tree::build_node(int k, int first, int last) {
+  node& n = pn[k];
+  if (last - first == 1) {
+    const light& l = pl[pidx[first]];
+    glm::vec4 c = l.diffuse() + l.specular();
+    n.bmin = l.position();
+    n.bmax = l.position();
+    n.power = 0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z;
+    n.range = l.range();
+    n.child = -1;
+    n.light = pidx[first];
+    return;
+  }
+  // split at the median of the longest axis of the positions
+  glm::vec3 bmin = pl[pidx[first]].position();
+  glm::vec3 bmax = bmin;
+  for (int j = first + 1; j < last; ++j) {
+    bmin = glm::min(bmin, pl[pidx[j]].position());
+    bmax = glm::max(bmax, pl[pidx[j]].position());
+  }
+  glm::vec3 e = bmax - bmin;
+  int axis = (e.x > e.y) ? ((e.x > e.z) ? 0 : 2) : ((e.y > e.z) ? 1 : 2);
+  int mid = (first + last) / 2;
+  const light* l = pl;
+  std::nth_element(pidx + first, pidx + mid, pidx + last,
+                   [l, axis](int a, int b) {
+                     return l[a].position()[axis] < l[b].position()[axis];
+                   });
+  int c = nn;
+  nn += 2;
+  build_node(c, first, mid);
+  build_node(c + 1, mid, last);
+  const node& n0 = pn[c];
+  const node& n1 = pn[c + 1];
+  n.bmin = glm::min(n0.bmin, n1.bmin);
+  n.bmax = glm::max(n0.bmax, n1.bmax);
+  n.power = n0.power + n1.power;
+  n.range = ((n0.range > 0.0f) && (n1.range > 0.0f))
+                ? std::max(n0.range, n1.range)
+                : 0.0f;
+  n.child = c;
+  n.light = -1;
+}
+
+float light_tree::importance(const node& n, glm::vec3 p,
+                             glm::vec3 nrm) const {
+  if (n.power <= 0.0f) return 0.0f;
+  // distance from p to the box
+  glm::vec3 d =
+      glm::max(glm::max(n.bmin - p, p - n.bmax), glm::vec3(0.0f));
+  float d2 = glm::dot(d, d);
+  // out of reach of all the lights below
+  if ((n.range > 0.0f) && (d2 >= n.range * n.range)) return 0.0f;
+  // the whole box is behind the surface
+  glm::vec3 c = (n.bmin + n.bmax) * 0.5f;
+  glm::vec3 h = (n.bmax - n.bmin) * 0.5f;
+  if (glm::dot(c - p, nrm) + glm::dot(h, glm::abs(nrm)) <= 0.0f) return 0.0f;
+  // no closer than the box size (the lights are spread inside)
+  d2 = std::max(std::max(d2, glm::dot(h, h)), 1e-4f);
+  return n.power / d2;
+}
+
+int light_tree::sample(glm::vec3 p, glm::vec3 nrm, float u,
+                       float* pdf) const {
+  assert(nn);
+  assert(pdf);
+  if (importance(pn[0], p, nrm) <= 0.0f) return -1;
+  float prob = 1.0f;
+  int k = 0;
+  while (pn[k].child >= 0) {
+    int c = pn[k].child;
+    float i0 = importance(pn[c], p, nrm);
+    float i1 = importance(pn[c + 1], p, nrm);
+    // the parent box passed but none of the children can reach p
+    if (i0 + i1 <= 0.0f) return -1;
+    float p0 = i0 / (i0 + i1);
+    // reuse u for the next choice
+    if (u < p0) {
+      u = u / p0;
+      prob *= p0;
+      k = c;
+    } else {
+      u = (u - p0) / (1.0f - p0);
+      prob *= 1.0f - p0;
+      k = c + 1;
+    }
+    u = std::min(u, 0.99999994f);
+  }
+  *pdf = prob;
+  return pn[k].light;
+}
+
+}  // end namespace miniRT
@@ -0,0 +1,72 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT light tree (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// binary hierarchy over the lights (median split of the positions)
+// with the power and the reach of every node. a light is picked for a
+// shading point by walking down the tree, each child being chosen in
+// proportion of its power over its squared distance, the probability
+// of the walk is returned so that contribution / probability is an
+// unbiased estimate of the sum over all the lights.
+
+#ifndef __MINIRT_LIGHT_TREE_DEFINED__
+#define __MINIRT_LIGHT_TREE_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class light;
+
+// integer hash (good enough to decorrelate the pixels and the frames)
+inline unsigned int hash_uint(unsigned int x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// uniform in [0, 1[
+inline float hash_float(unsigned int x) {
+  return (float)(hash_uint(x) >> 8) * (1.0f / 16777216.0f);
+}
+
+class light_tree {
+  struct node {
+    glm::vec3 bmin;
+    glm::vec3 bmax;
+    // diffuse + specular luminance of the lights below
+    float power;
+    // largest range below (0 if one of them is infinite)
+    float range;
+    // first child (the second one follows) or -1 for a leaf
+    int child;
+    int light;
+  };
+  node* pn;
+  int nn;
+  int maxn;
+  int* pidx;
+  const light* pl;
+  void build_node(int k, int first, int last);
+  float importance(const node& n, glm::vec3 p, glm::vec3 nrm) const;
+
+ public:
+  light_tree();
+  ~light_tree();
+  // rebuild over the lights (when one of them changed)
+  void build(const light* l, int lcount);
+  bool empty() const { return !nn; }
+  // pick a light for the point p of normal nrm with u in [0, 1[,
+  // return -1 if no light can reach p, the probability of the choice
+  // is stored in pdf
+  int sample(glm::vec3 p, glm::vec3 nrm, float u, float* pdf) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_LIGHT_TREE_DEFINED__
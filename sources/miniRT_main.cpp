@@ -16,11 +16,26 @@ static int dy = 480;
 const float MOVE_SPEED = 0.05f;
 const float ROTATE_FACT = 0.02f;
 glm::vec3 delta;
+int shadow = shadow_ray;
+bool occlusion = false;
+bool baked = false;
+int samples = 0;
+bool shadows = true;
+bool textured = false;
+int shading = 1;
+bool reinhard = false;
+bool analytic = false;
+bool progressive = false;
+int reuse = 0;
+float target = 0.0f;
+bool checker = false;
+bool foveated = false;
 
 render* ren = 0;
 camera* cam = 0;
 teapot* tea = 0;
 icosahedron* ico = 0;
+texture* tex = 0;
 
 void rtwin::key_up(int key, int x, int y, window* w) {
   switch (key) {
@@ -68,6 +83,91 @@ void rtwin::key_down(int key, int x, int y, window* w) {
         delta[0] = -MOVE_SPEED;
       }
       return;
+    case 'm':
+      // shadow rays, shadow map or distance field
+      shadow = (shadow + 1) % 3;
+      ren->set_shadow_technique(0, (shadow_technique)shadow);
+      return;
+    case 'o':
+      occlusion = !occlusion;
+      ren->set_ambient_occlusion(occlusion);
+      return;
+    case 'b':
+      // baked lighting (static lights and geometry)
+      baked = !baked;
+      ren->set_baked_lighting(baked);
+      return;
+    case 'l':
+      // every light or 4 sampled lights per pixel (accumulated)
+      samples = samples ? 0 : 4;
+      ren->set_light_samples(samples);
+      return;
+    case 'h':
+      shadows = !shadows;
+      ren->set_shadows(shadows);
+      return;
+    case 't':
+      // texture on the floor
+      textured = !textured;
+      ren->set_texture(textured ? tex : 0);
+      return;
+    case 'v':
+      // shade every pixel, 2x2 or 4x4 uniform cells
+      shading = (shading == 4) ? 1 : shading * 2;
+      ren->set_shading_rate(shading);
+      return;
+    case 'x':
+      // clamp or Reinhard tonemap
+      reinhard = !reinhard;
+      ren->set_tonemap(reinhard ? tonemap_reinhard : tonemap_clamp);
+      return;
+    case 'g':
+      // analytic sphere and disk next to the icosahedron
+      analytic = !analytic;
+      if (!analytic) {
+        ren->clear_primitives();
+        return;
+      }
+      ren->add_primitive(primitive(primitive_sphere,
+                                   glm::vec3(-0.9f, 0.0f, 0.4f),
+                                   glm::vec3(0.0f, 1.0f, 0.0f), 0.35f,
+                                   glm::vec3(0.9f, 0.3f, 0.3f)));
+      ren->add_primitive(primitive(primitive_disk,
+                                   glm::vec3(0.5f, 0.0f, -0.5f),
+                                   glm::vec3(0.3f, 1.0f, 0.2f), 0.25f,
+                                   glm::vec3(0.3f, 0.3f, 0.9f)));
+      return;
+    case 'r':
+      // coarse to fine after every move
+      progressive = !progressive;
+      ren->set_progressive(progressive);
+      return;
+    case 'p':
+      // reuse the colours of the last frames (up to 8)
+      reuse = reuse ? 0 : 8;
+      ren->set_reprojection(reuse);
+      return;
+    case 'f':
+      // hold 30 frames per second by lowering the resolution
+      target = (target > 0.0f) ? 0.0f : 33.0f;
+      ren->set_target_frame_time(target);
+      return;
+    case 'c':
+      // half the pixels per frame
+      checker = !checker;
+      ren->set_checkerboard(checker);
+      return;
+    case 'e':
+      // full resolution around the mouse only
+      foveated = !foveated;
+      ren->set_foveation(foveated);
+      return;
+    case '=':
+      ren->set_exposure(ren->get_exposure() * 1.25f);
+      return;
+    case '-':
+      ren->set_exposure(ren->get_exposure() / 1.25f);
+      return;
   }
 }
 
@@ -103,6 +203,11 @@ void rtwin::motion(int x, int y, window* w) {
     cam->set_to(glm::normalize(cam->get_to()));
     cam->set_right(glm::normalize(cam->get_right()));
     cam->fix_perp();
+    // looking ahead while turning
+    ren->set_gaze((float)dx * 0.5f, (float)dy * 0.5f);
+  } else {
+    // looking at the mouse
+    ren->set_gaze((float)x, (float)y);
   }
   ren->set_camera(*cam);
 }
@@ -118,6 +223,7 @@ void rtwin::update(window* w) {
   ren->clear_buffer();
   ren->begin();
   ren->draw_indexed_triangles(0, 20);
+  ren->draw_primitives();
   ren->present();
   ren->end();
   if ((w->get_tick() - first) > 1000) {
@@ -130,7 +236,11 @@ void rtwin::update(window* w) {
   }
   char temp[512];
   memset(temp, 0, 512);
-  sprintf_s(temp, 128, "miniRT : FPS %f : ", (float)fps);
+  sprintf_s(temp, 256,
+            "miniRT : FPS %f : history %f : occluder %f : reuse %f : "
+            "scale %f (%f ms)",
+            (float)fps, ren->history_hit_rate(), ren->occluder_hit_rate(),
+            ren->reuse_rate(), ren->resolution_scale(), ren->frame_time());
   w->set_title(temp, "miniRT");
   cam->set_pos(cam->get_pos() + (cam->get_right() * delta[0]));
   cam->set_pos(cam->get_pos() + (cam->get_to() * delta[2]));
@@ -141,11 +251,24 @@ int main(int ac, char** av) {
   light lt;
   ico = new icosahedron();
   tea = new teapot();
+  // compressed texture (see miniRT_bcenc) or a 64 x 64 checker of
+  // 8 x 8 texels
+  if (ac > 1) tex = texture::load(av[1]);
+  if (!tex) {
+    unsigned int* checker = new unsigned int[64 * 64];
+    for (int y = 0; y < 64; ++y)
+      for (int x = 0; x < 64; ++x)
+        checker[y * 64 + x] =
+            (((x >> 3) + (y >> 3)) & 1) ? 0x00404040 : 0x00ffffff;
+    tex = new texture(64, 64, checker, true);
+    delete[] checker;
+  }
   glm::vec3 up(0.0f, 0.80f, 0.60f);
   glm::vec3 pos(0.0f, 1.10f, -1.75f);
   glm::vec3 ltpos(3.0f, 3.0f, -3.0f);
   glm::vec3 to(0.0f, -0.60f, 0.80f);
   lt.position() = ltpos;
+  lt.set_radius(0.25f);
   cam = new camera(up, to, pos);
   rtwin* main_win = new rtwin();
   window* cwin = new window();
@@ -16,6 +16,7 @@
 #include "miniRT_new.h"
 #include "miniRT_render.h"
 #include "miniRT_screen_buffer.h"
+#include "miniRT_texture.h"
 #include "miniRT_triangle.h"
 #include "miniRT_vertex.h"
 #include "miniRT_vertex_buffer.h"
@@ -0,0 +1,46 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT occluder cache (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// last triangles found to occlude a light, most recent first (LRU).
+// one per light and per tile : neighbouring pixels almost always share
+// their occluder and nothing is shared between tiles.
+
+#ifndef __MINIRT_OCCLUDER_CACHE_DEFINED__
+#define __MINIRT_OCCLUDER_CACHE_DEFINED__
+
+namespace miniRT {
+
+class occluder_cache {
+  static const int max_occluder = 4;
+  int occ[max_occluder];
+  int nb;
+
+ public:
+  occluder_cache() : nb(0) {}
+  void clear() { nb = 0; }
+  int size() const { return nb; }
+  int get(int i) const { return occ[i]; }
+  bool contains(int k) const {
+    for (int i = 0; i < nb; ++i)
+      if (occ[i] == k) return true;
+    return false;
+  }
+  // move k (or insert it) in front, dropping the least recently used
+  void touch(int k) {
+    int i = 0;
+    while (i < nb && occ[i] != k) ++i;
+    if (i == nb) {
+      if (nb < max_occluder) ++nb;
+      i = nb - 1;
+    }
+    for (; i > 0; --i) occ[i] = occ[i - 1];
+    occ[0] = k;
+  }
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_OCCLUDER_CACHE_DEFINED__
@@ -0,0 +1,48 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT packet (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// 2x4 primary ray packets, one float4 per packet row and component.
+
+#ifndef __MINIRT_PACKET_DEFINED__
+#define __MINIRT_PACKET_DEFINED__
+
+#include <glm/glm.hpp>
+
+#include "miniRT_simd.h"
+
+namespace miniRT {
+
+// packet size
+const int packet_dx = 4;
+const int packet_dy = 2;
+
+// directions of the 8 rays (rays share the camera origin)
+struct ray_packet {
+  float4 dx[packet_dy];
+  float4 dy[packet_dy];
+  float4 dz[packet_dy];
+};
+
+// per lane result, lane (x, y) is bit (y * packet_dx + x) of mask
+struct packet_hit {
+  float4 t[packet_dy];
+  float4 u[packet_dy];
+  float4 v[packet_dy];
+  int mask;
+};
+
+// triangle values shared by all the rays of the packets (same origin)
+struct packet_triangle {
+  glm::vec3 edge1;
+  glm::vec3 edge2;
+  glm::vec3 tvec;
+  glm::vec3 qvec;
+  float tnum;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_PACKET_DEFINED__
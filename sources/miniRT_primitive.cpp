@@ -0,0 +1,74 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT primitive
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_primitive.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+#include <limits>
+
+namespace miniRT {
+
+bool primitive::intersect(glm::vec3 pos, glm::vec3 dir, float tmin,
+                          float tmax, float* t) const {
+  assert(t);
+  const float eps = std::numeric_limits<float>::epsilon();
+  if (type == primitive_sphere) {
+    // |pos + t dir - centre|^2 = rad^2
+    glm::vec3 oc = pos - centre;
+    float a = glm::dot(dir, dir);
+    float b = glm::dot(oc, dir);
+    float c = glm::dot(oc, oc) - rad * rad;
+    float disc = b * b - a * c;
+    if (disc < 0.0f) return false;
+    float s = sqrtf(disc);
+    // the near side, or the far one from inside
+    float h = (-b - s) / a;
+    if (h <= tmin) h = (-b + s) / a;
+    if ((h <= tmin) || (h >= tmax)) return false;
+    *t = h;
+    return true;
+  }
+  float dn = glm::dot(dir, norm);
+  if (fabsf(dn) <= eps) return false;
+  float h = glm::dot(centre - pos, norm) / dn;
+  if ((h <= tmin) || (h >= tmax)) return false;
+  if (type == primitive_disk) {
+    glm::vec3 d = pos + dir * h - centre;
+    if (glm::dot(d, d) > rad * rad) return false;
+  }
+  *t = h;
+  return true;
+}
+
+glm::vec3 primitive::normal(glm::vec3 p, glm::vec3 pos) const {
+  if (type == primitive_sphere) return (p - centre) * (1.0f / rad);
+  return (glm::dot(pos - centre, norm) < 0.0f) ? -norm : norm;
+}
+
+bool primitive::bounds(glm::vec3* bmin, glm::vec3* bmax) const {
+  assert(bmin);
+  assert(bmax);
+  if (type == primitive_plane) return false;
+  glm::vec3 e(rad);
+  if (type == primitive_disk) {
+    // extent of the circle along each axis
+    glm::vec3 n2 = norm * norm;
+    e = glm::vec3(sqrtf(std::max(0.0f, 1.0f - n2.x)),
+                  sqrtf(std::max(0.0f, 1.0f - n2.y)),
+                  sqrtf(std::max(0.0f, 1.0f - n2.z))) *
+        rad;
+  }
+  *bmin = centre - e;
+  *bmax = centre + e;
+  return true;
+}
+
+}  // end namespace miniRT
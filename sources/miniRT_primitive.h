@@ -0,0 +1,58 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT primitive (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// analytic shapes (closed form intersection, normal and bounds) drawn
+// next to the indexed triangles, see render::draw_primitives.
+
+#ifndef __MINIRT_PRIMITIVE_DEFINED__
+#define __MINIRT_PRIMITIVE_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+enum primitive_type {
+  primitive_sphere = 0,  // centre and radius
+  primitive_plane = 1,   // point and normal (infinite)
+  primitive_disk = 2     // centre, normal and radius
+};
+
+class primitive {
+  primitive_type type;
+  glm::vec3 centre;
+  glm::vec3 norm;
+  float rad;
+  glm::vec3 col;
+
+ public:
+  primitive()
+      : type(primitive_sphere),
+        centre(0.0f),
+        norm(0.0f, 1.0f, 0.0f),
+        rad(1.0f),
+        col(1.0f) {}
+  primitive(primitive_type t,  // shape
+            glm::vec3 c,       // centre (or point of the plane)
+            glm::vec3 n,       // normal (plane and disk)
+            float r,           // radius (sphere and disk)
+            glm::vec3 colour)
+      : type(t), centre(c), norm(glm::normalize(n)), rad(r), col(colour) {}
+  primitive_type shape() const { return type; }
+  glm::vec3 position() const { return centre; }
+  glm::vec3 colour() const { return col; }
+  float radius() const { return rad; }
+  // first hit in ]tmin, tmax[ along dir (distance in dir units)
+  bool intersect(glm::vec3 pos, glm::vec3 dir, float tmin, float tmax,
+                 float* t) const;
+  // unit normal at p on the surface, the plane and the disk face pos
+  glm::vec3 normal(glm::vec3 p, glm::vec3 pos) const;
+  // false if unbounded (plane)
+  bool bounds(glm::vec3* bmin, glm::vec3* bmax) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_PRIMITIVE_DEFINED__
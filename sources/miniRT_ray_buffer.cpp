@@ -0,0 +1,93 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT ray buffer
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_ray_buffer.h"
+
+#include <assert.h>
+
+#include <glm/glm.hpp>
+
+#include "miniRT_new.h"
+#include "miniRT_simd.h"
+
+namespace miniRT {
+
+ray_buffer::ray_buffer(int x, int y) {
+  assert(x > 0);
+  assert(y > 0);
+  maxx = x;
+  maxy = y;
+  dx = x;
+  dy = y;
+  pdx = new float[x * y];
+  pdy = new float[x * y];
+  pdz = new float[x * y];
+  assert(pdx);
+  assert(pdy);
+  assert(pdz);
+  valid = false;
+}
+
+ray_buffer::~ray_buffer() {
+  if (pdx) delete[] pdx;
+  if (pdy) delete[] pdy;
+  if (pdz) delete[] pdz;
+}
+
+bool ray_buffer::update(glm::vec3 tl, glm::vec3 rs, glm::vec3 us, int x,
+                        int y) {
+  assert(x > 0 && x <= maxx);
+  assert(y > 0 && y <= maxy);
+  if (valid && (x == dx) && (y == dy) && (tl == top_left) &&
+      (rs == right_step) && (us == up_step))
+    return false;
+  top_left = tl;
+  right_step = rs;
+  up_step = us;
+  dx = x;
+  dy = y;
+  for (int j = 0; j < dy; ++j) {
+    glm::vec3 scan_line = top_left - up_step * (float)j;
+    float* px = pdx + j * dx;
+    float* py = pdy + j * dx;
+    float* pz = pdz + j * dx;
+    for (int i = 0; i < dx; ++i) {
+      px[i] = scan_line.x + right_step.x * (float)i;
+      py[i] = scan_line.y + right_step.y * (float)i;
+      pz[i] = scan_line.z + right_step.z * (float)i;
+    }
+    normalize_row(j);
+  }
+  valid = true;
+  return true;
+}
+
+void ray_buffer::normalize_row(int y) {
+  float* px = pdx + y * dx;
+  float* py = pdy + y * dx;
+  float* pz = pdz + y * dx;
+  int i = 0;
+  // 4 directions at a time
+  for (; i + 4 <= dx; i += 4) {
+    float4 x = float4::load(px + i);
+    float4 y = float4::load(py + i);
+    float4 z = float4::load(pz + i);
+    float4 inv_len = float4(1.0f) / sqrt(x * x + y * y + z * z);
+    (x * inv_len).store(px + i);
+    (y * inv_len).store(py + i);
+    (z * inv_len).store(pz + i);
+  }
+  // remaining
+  for (; i < dx; ++i) {
+    glm::vec3 d = glm::normalize(glm::vec3(px[i], py[i], pz[i]));
+    px[i] = d.x;
+    py[i] = d.y;
+    pz[i] = d.z;
+  }
+}
+
+}  // end namespace miniRT
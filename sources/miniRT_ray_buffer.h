@@ -0,0 +1,54 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT ray buffer (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// per pixel primary ray directions stored as SoA (x, y and z arrays).
+// the directions only depend on the camera orientation, the fov and
+// the resolution so they are kept as long as those stay the same (a
+// translation of the camera does not rebuild them).
+
+#ifndef __MINIRT_RAY_BUFFER_DEFINED__
+#define __MINIRT_RAY_BUFFER_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class ray_buffer {
+  float* pdx;
+  float* pdy;
+  float* pdz;
+  int maxx, maxy;
+  int dx, dy;
+  bool valid;
+  glm::vec3 top_left;
+  glm::vec3 right_step;
+  glm::vec3 up_step;
+  void normalize_row(int y);
+
+ public:
+  // allocate for a maximum resolution of x * y
+  ray_buffer(int x, int y);
+  ~ray_buffer();
+  // rebuild the directions for a x * y image if the steps or the
+  // resolution changed, return true if the buffer was regenerated
+  bool update(glm::vec3 tl, glm::vec3 rs, glm::vec3 us, int x, int y);
+  // force a rebuild at next update
+  void invalidate() { valid = false; }
+  int get_dx() const { return dx; }
+  int get_dy() const { return dy; }
+  glm::vec3 get(int x, int y) const {
+    int i = x + y * dx;
+    return glm::vec3(pdx[i], pdy[i], pdz[i]);
+  }
+  // raw rows (SoA)
+  const float* get_x(int y) const { return pdx + y * dx; }
+  const float* get_y(int y) const { return pdy + y * dx; }
+  const float* get_z(int y) const { return pdz + y * dx; }
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_RAY_BUFFER_DEFINED__
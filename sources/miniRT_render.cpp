@@ -9,15 +9,33 @@
 
 #include <assert.h>
 
+#include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <glm/glm.hpp>
 #include <limits>
+#include <thread>
+#include <vector>
 
+#include "miniRT_bake.h"
 #include "miniRT_cam.h"
+#include "miniRT_frustum.h"
 #include "miniRT_index_buffer.h"
 #include "miniRT_light.h"
+#include "miniRT_light_class.h"
+#include "miniRT_light_tree.h"
 #include "miniRT_new.h"
+#include "miniRT_occluder_cache.h"
+#include "miniRT_packet.h"
+#include "miniRT_primitive.h"
+#include "miniRT_ray_buffer.h"
 #include "miniRT_screen_buffer.h"
+#include "miniRT_sdf.h"
+#include "miniRT_shade.h"
+#include "miniRT_shadow_map.h"
+#include "miniRT_simd.h"
+#include "miniRT_texture.h"
+#include "miniRT_tile.h"
 #include "miniRT_triangle.h"
 #include "miniRT_vertex.h"
 #include "miniRT_vertex_buffer.h"
@@ -33,15 +51,24 @@
 #else
 #include <GL/gl.h>
 #endif
-//#define WITHOUT_SHADOW 1
 
 // Remove conflicting macro.
 #ifdef max
 #undef max
 #endif
+#ifdef min
+#undef min
+#endif
 
 namespace miniRT {
 
+// milliseconds of a monotonic clock
+static double now_ms() {
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 render::render(window* w, int x, int y, int obj) {
   assert(w);
   assert(x);
@@ -50,19 +77,123 @@ render::render(window* w, int x, int y, int obj) {
 
   bound_tri = new glm::vec4[obj];
   pzsb = new screen_buffer<float>(x, y);
+  ppzsb = new screen_buffer<float>(x, y);
+  phdr = new screen_buffer<glm::vec4>(x, y);
+  pphdr = new screen_buffer<glm::vec4>(x, y);
   pisb = new screen_buffer<unsigned int>(x, y);
+  exposure = 1.0f;
+  tonemap_op = tonemap_clamp;
+  prb = new ray_buffer(x, y);
+  pidsb = new screen_buffer<int>(x, y);
+  ppidsb = new screen_buffer<int>(x, y);
+  pidsb->clear(-1);
+  ppidsb->clear(-1);
+  history_tests = 0;
+  history_hits = 0;
+  puvsb = new screen_buffer<glm::vec2>(x, y);
+  ppt = new packet_triangle[obj];
+  pbox = new glm::vec3[obj * 2];
+  pchunk = new glm::vec3[(obj / chunk_size + 1) * 2];
+  pcand = 0;
+  pncand = 0;
+  pocc = 0;
+  ptl = 0;
+  ntl = 0;
+  plc = new light_classifier();
+  light_classes = true;
+  shadow_rate = 1;
+#ifdef WITHOUT_SHADOW
+  shadows = false;
+#else
+  shadows = true;
+#endif  // WITHOUT_SHADOW
+  shading_rate = 1;
+  flat_colour = false;
+  ptexture = 0;
+  trilinear = true;
+  pphong = phong_table[0];
+  psm = 0;
+  shadow_map_size = 256;
+  pdf = new sdf();
+  sdf_voxel = 0.05f;
+  ambient_occlusion = false;
+  pbk = new light_bake();
+  baked_lighting = false;
+  bake_texel = 0.1f;
+  plt = new light_tree();
+  light_samples = 0;
+  tree_light_version = -1;
+  pacc = new screen_buffer<glm::vec3>(x, y);
+  acc_frames = 0;
+  acc_pos = glm::vec3(0.0f);
+  acc_light_version = -1;
+  acc_scene_version = -1;
+  progressive = false;
+  prog_step = 0;
+  back = glm::vec4(0.0f);
+  reuse_age = 0;
+  history_colour = false;
+  reusing = false;
+  reuse_tests = 0;
+  reuse_hits = 0;
+  checkerboard = false;
+  checkering = false;
+  checker_parity = 0;
+  prev_checkering = false;
+  prev_parity = 0;
+  foveation = false;
+  foveating = false;
+  gaze = glm::vec2((float)x * 0.5f, (float)y * 0.5f);
+  fovea_inner = (float)y * 0.25f;
+  fovea_outer = (float)y * 0.5f;
+  fovea_tiles = (x + tile_size - 1) / tile_size;
+  pfovea = new int[fovea_tiles * ((y + tile_size - 1) / tile_size)];
+  target_ms = 0.0f;
+  frame_ms = 0.0f;
+  frame_start = 0.0;
+  scale = 1.0f;
+  light_version = 0;
+  scene_version = 0;
+  vb_version = 0;
+  class_light_version = -1;
+  class_scene_version = -1;
+  occluder_tests = 0;
+  occluder_hits = 0;
+  psb = new shade_batch;
+  tri = 0;
   pib = 0;
   pvb = 0;
   pl = 0;
   lcount = 0;
+  pprim = 0;
+  nprim = 0;
   // check allocation
   assert(bound_tri);
   assert(pzsb);
+  assert(ppzsb);
+  assert(phdr);
+  assert(pphdr);
   assert(pisb);
+  assert(prb);
+  assert(pidsb);
+  assert(ppidsb);
+  assert(puvsb);
+  assert(ppt);
+  assert(pbox);
+  assert(pchunk);
+  assert(psb);
+  assert(plc);
+  assert(pdf);
+  assert(pbk);
+  assert(plt);
+  assert(pacc);
+  assert(pfovea);
   // clean it
   pw = w;
   dx = x;
   dy = y;
+  odx = x;
+  ody = y;
   maxobj = obj;
   lock = false;
 }
@@ -74,8 +205,31 @@ render::~render() {
   if (bound_tri) delete[] bound_tri;
   if (tri) delete tri;
   if (pzsb) delete pzsb;
+  if (ppzsb) delete ppzsb;
+  if (phdr) delete phdr;
+  if (pphdr) delete pphdr;
   if (pisb) delete pisb;
+  if (prb) delete prb;
+  if (pidsb) delete pidsb;
+  if (ppidsb) delete ppidsb;
+  if (puvsb) delete puvsb;
+  if (ppt) delete[] ppt;
+  if (pbox) delete[] pbox;
+  if (pchunk) delete[] pchunk;
+  if (pcand) delete[] pcand;
+  if (pncand) delete[] pncand;
+  if (pocc) delete[] pocc;
+  if (ptl) delete[] ptl;
+  if (plc) delete plc;
+  if (psm) delete[] psm;
+  if (pdf) delete pdf;
+  if (pbk) delete pbk;
+  if (plt) delete plt;
+  if (pacc) delete pacc;
+  if (psb) delete psb;
   if (pl) delete[] pl;
+  if (pprim) delete[] pprim;
+  if (pfovea) delete[] pfovea;
 }
 
 bool render::begin() {
@@ -84,14 +238,75 @@ bool render::begin() {
   assert(pib);
   assert(pzsb);
 
+  // the vertex buffer changed since the records were built
+  if (pvb->version() != vb_version) build_bounds();
+  if ((light_classes || baked_lighting) &&
+      ((class_light_version != light_version) ||
+       (class_scene_version != scene_version))) {
+    plc->build(tri, pvb, pbox, pchunk, chunk_size, pl, lcount);
+    class_light_version = light_version;
+    class_scene_version = scene_version;
+  }
+  if (baked_lighting)
+    pbk->update(tri, pvb, plc, pl, lcount, bake_texel, light_version,
+                scene_version);
+  bool field = ambient_occlusion;
+  for (int j = 0; j < lcount; ++j) {
+    if (pl[j].technique() == shadow_map_cube)
+      psm[j].update(tri, pl[j].position(), scene_version, shadow_map_size);
+    if (pl[j].technique() == shadow_sdf) field = true;
+  }
+  if (field) pdf->update(tri, sdf_voxel, scene_version);
+  if ((light_samples > 0) && (tree_light_version != light_version)) {
+    plt->build(pl, lcount);
+    tree_light_version = light_version;
+  }
+  // shading variant for the frame
+  bool specular = false;
+  for (int j = 0; j < lcount; ++j) {
+    glm::vec4 s = pl[j].specular();
+    if ((s.x != 0.0f) || (s.y != 0.0f) || (s.z != 0.0f)) specular = true;
+  }
+  pphong = phong_table[(shadows ? 8 : 0) + ((lcount > 1) ? 4 : 0) +
+                       (flat_colour ? 0 : 2) + (specular ? 1 : 0)];
+
+  // render size of the frame (the aspect of the window)
+  int ndy = std::max(1, (int)((float)ody * scale + 0.5f));
+  int ndx = std::min(odx, std::max(1, (int)((float)odx * (float)ndy /
+                                                (float)ody +
+                                            0.5f)));
+  if ((ndx != dx) || (ndy != dy)) {
+    dx = ndx;
+    dy = ndy;
+    // the last frame is at another size
+    restart();
+  }
   float width = 2.0f * tanf(cam.get_fov());
-  float height = width * ((float)dy / (float)dx);
+  float height = width * ((float)ody / (float)odx);
 
   top_left = cam.get_to();
   top_left += (cam.get_up() * (height * 0.5f));
   top_left -= (cam.get_right() * (width * 0.5f));
   right_step = cam.get_right() * height * (1.0f / (float)dy);
   up_step = cam.get_up() * height * (1.0f / (float)dy);
+  // only regenerated when the camera orientation changed
+  bool turned = prb->update(top_left, right_step, up_step, dx, dy);
+  // restart the running average when the view or the scene changed
+  bool changed = (acc_light_version != light_version) ||
+                 (acc_scene_version != scene_version);
+  if (turned || (cam.get_pos() != acc_pos) || changed) {
+    // the colours of the last frame are still valid if only the view
+    // changed
+    bool keep = history_colour && !changed;
+    restart();
+    history_colour = keep;
+    acc_pos = cam.get_pos();
+    acc_light_version = light_version;
+    acc_scene_version = scene_version;
+  }
+  foveating = foveation && !prog_step && !light_samples;
+  if (foveating) build_fovea();
+  checkering = checkerboard && !prog_step && !light_samples && !foveating;
 
   glm::vec3 start;
   glm::vec3 pos = cam.get_pos();
@@ -157,15 +372,65 @@ void render::set_vertex_buffer(vertex_buffer* vb) {
   assert(!lock);
   assert(vb);
   pvb = vb;
+  if (tri) delete tri;
   tri = new triangle(pvb);
   assert(tri);
+  if (pib) build_bounds();
 }
 
 void render::set_index_buffer(index_buffer* ib) {
   assert(!lock);
   assert(ib);
   assert(!(ib->size() % 3));
+  assert(ib->size() / 3 <= maxobj);
   pib = ib;
+  if (pvb) build_bounds();
+}
+
+void render::set_texture(texture* t) {
+  assert(!lock);
+  ptexture = t;
+  restart();
+}
+
+void render::build_bounds() {
+  assert(pvb);
+  assert(pib);
+  assert(tri);
+  tri->build(pib);
+  ++scene_version;
+  vb_version = pvb->version();
+  int nb_tri = pib->size() / 3;
+  glm::vec3 p0, p1, p2;
+  for (int i = 0; i < nb_tri; ++i) {
+    get_triangle(i, &p0, &p1, &p2);
+    pbox[i * 2] = glm::min(p0, glm::min(p1, p2));
+    pbox[i * 2 + 1] = glm::max(p0, glm::max(p1, p2));
+    int c = i / chunk_size;
+    if (i % chunk_size) {
+      pchunk[c * 2] = glm::min(pchunk[c * 2], pbox[i * 2]);
+      pchunk[c * 2 + 1] = glm::max(pchunk[c * 2 + 1], pbox[i * 2 + 1]);
+    } else {
+      pchunk[c * 2] = pbox[i * 2];
+      pchunk[c * 2 + 1] = pbox[i * 2 + 1];
+    }
+  }
+  // no colour to interpolate
+  flat_colour = true;
+  for (int i = 0; (i < nb_tri) && flat_colour; ++i) {
+    const tri_record& r = tri->get_record(i);
+    glm::vec3 c = pvb->get_color(r.vi[0]);
+    flat_colour = (pvb->get_color(r.vi[1]) == c) &&
+                  (pvb->get_color(r.vi[2]) == c);
+  }
+}
+
+void render::get_triangle(int i, glm::vec3* p0, glm::vec3* p1,
+                          glm::vec3* p2) {
+  const tri_record& r = tri->get_record(i);
+  *p0 = r.v0;
+  *p1 = r.v0 + r.edge1;
+  *p2 = r.v0 + r.edge2;
 }
 
 bool render::draw_indexed_triangles(int first, int last) {
@@ -182,67 +447,910 @@ bool render::draw_indexed_triangles(int first, int last) {
   assert(last < nbobj);
   assert(first <= last);
 
-  const glm::vec4 nullvec = glm::vec4(-1.0);
+  // last frame visible triangles first to get a tight Z (not for the
+  // sparse levels of the progressive mode)
+  if (prog_step <= 1) draw_history(first, last);
+
   glm::vec3 pos = cam.get_pos();
+  for (int i = first; i <= last; ++i) tri->setup_packet(i, pos, &ppt[i]);
+  for (int y = 0; y < dy; y += tile_size)
+    for (int x = 0; x < dx; x += tile_size)
+      draw_tile(tile(x, y, std::min(x + tile_size, dx),
+                     std::min(y + tile_size, dy)),
+                first, last);
+  return true;
+}
+
+void render::draw_tile(const tile& t, int first, int last) {
+  // frustum through the pixel corners (half a pixel around the rays)
+  float l = (float)t.x0 - 0.5f;
+  float r = (float)t.x1 - 0.5f;
+  float u = (float)t.y0 - 0.5f;
+  float d = (float)t.y1 - 0.5f;
+  frustum f(cam.get_pos(), top_left + right_step * l - up_step * u,
+            top_left + right_step * r - up_step * u,
+            top_left + right_step * r - up_step * d,
+            top_left + right_step * l - up_step * d);
+  glm::vec3 p0, p1, p2;
+  for (int c = first / chunk_size; c <= last / chunk_size; ++c) {
+    // whole group of triangles out of the tile
+    if (f.cull_box(pchunk[c * 2], pchunk[c * 2 + 1])) continue;
+    int cfirst = std::max(first, c * chunk_size);
+    int clast = std::min(last, c * chunk_size + chunk_size - 1);
+    for (int i = cfirst; i <= clast; ++i) {
+      glm::vec4 bound = bound_tri[i];
+      int x0 = std::max(t.x0, (int)bound.x);
+      int x1 = std::min(t.x1, (int)bound.z);
+      int y0 = std::max(t.y0, (int)bound.y);
+      int y1 = std::min(t.y1, (int)bound.w);
+      if (x0 >= x1 || y0 >= y1) continue;
+      if (f.cull_box(pbox[i * 2], pbox[i * 2 + 1])) continue;
+      get_triangle(i, &p0, &p1, &p2);
+      if (f.cull_triangle(p0, p1, p2)) continue;
+      // sparse level or far from the gaze point, single rays
+      int s = std::max(prog_step, tile_step(t));
+      if (s > 1) {
+        int m = s - 1;
+        for (int y = (y0 + m) & ~m; y < y1; y += s)
+          for (int x = (x0 + m) & ~m; x < x1; x += s)
+            if (level_pixel(x, y)) draw_ray(i, x, y);
+        continue;
+      }
+      if (checkering) {
+        // the packets take every other pixel of 8 columns
+        for (int y = y0; y < y1; y += packet_dy) {
+          int x = x0;
+          if (y + packet_dy <= y1)
+            for (; x + packet_dx * 2 <= x1; x += packet_dx * 2)
+              draw_checker_packet(i, ppt[i], x, y);
+          for (int py = y; py < y + packet_dy && py < y1; ++py)
+            for (int px = x; px < x1; ++px)
+              if (checker_pixel(px, py)) draw_ray(i, px, py);
+        }
+        continue;
+      }
+      for (int y = y0; y < y1; y += packet_dy) {
+        int x = x0;
+        if (y + packet_dy <= y1)
+          for (; x + packet_dx <= x1; x += packet_dx)
+            draw_packet(i, ppt[i], x, y);
+        // the packet does not fit in the bound anymore, single rays
+        for (int py = y; py < y + packet_dy && py < y1; ++py)
+          for (int px = x; px < x1; ++px) draw_ray(i, px, py);
+      }
+    }
+  }
+}
+
+void render::draw_packet(int i, const packet_triangle& pt, int x, int y) {
+  ray_packet rp;
+  packet_hit ph;
+  for (int r = 0; r < packet_dy; ++r) {
+    rp.dx[r] = float4::load(prb->get_x(y + r) + x);
+    rp.dy[r] = float4::load(prb->get_y(y + r) + x);
+    rp.dz[r] = float4::load(prb->get_z(y + r) + x);
+  }
+  int mask = tri->intersect_packet(pt, rp, &ph);
+  if (!mask) return;
+  for (int r = 0; r < packet_dy; ++r) {
+    // Z test for the whole row (the row is contiguous in the Z buffer)
+    float4 z = float4::load(&(*pzsb)(x, y + r));
+    mask &= ~((~movemask(ph.t[r] < z) & 0xf) << (r * packet_dx));
+  }
+  for (int r = 0; r < packet_dy; ++r) {
+    for (int l = 0; l < packet_dx; ++l) {
+      if (!(mask & (1 << (r * packet_dx + l)))) continue;
+      int px = x + l;
+      int py = y + r;
+      // already found by the history pass
+      if ((*pidsb)(px, py) == i) continue;
+      (*pzsb)(px, py) = ph.t[r][l];
+      (*pidsb)(px, py) = i;
+      (*puvsb)(px, py) = glm::vec2(ph.u[r][l], ph.v[r][l]);
+    }
+  }
+}
+
+void render::draw_checker_packet(int i, const packet_triangle& pt, int x,
+                                 int y) {
+  ray_packet rp;
+  packet_hit ph;
+  // first column of each row on the current colour
+  int o[packet_dy];
+  for (int r = 0; r < packet_dy; ++r) {
+    o[r] = (x + y + r + checker_parity) & 1;
+    const float* rx = prb->get_x(y + r) + x + o[r];
+    const float* ry = prb->get_y(y + r) + x + o[r];
+    const float* rz = prb->get_z(y + r) + x + o[r];
+    float gx[packet_dx], gy[packet_dx], gz[packet_dx];
+    for (int l = 0; l < packet_dx; ++l) {
+      gx[l] = rx[l * 2];
+      gy[l] = ry[l * 2];
+      gz[l] = rz[l * 2];
+    }
+    rp.dx[r] = float4::load(gx);
+    rp.dy[r] = float4::load(gy);
+    rp.dz[r] = float4::load(gz);
+  }
+  int mask = tri->intersect_packet(pt, rp, &ph);
+  if (!mask) return;
+  for (int r = 0; r < packet_dy; ++r) {
+    for (int l = 0; l < packet_dx; ++l) {
+      if (!(mask & (1 << (r * packet_dx + l)))) continue;
+      int px = x + o[r] + l * 2;
+      int py = y + r;
+      // already found by the history pass
+      if ((*pidsb)(px, py) == i) continue;
+      if (!(ph.t[r][l] < (*pzsb)(px, py))) continue;
+      (*pzsb)(px, py) = ph.t[r][l];
+      (*pidsb)(px, py) = i;
+      (*puvsb)(px, py) = glm::vec2(ph.u[r][l], ph.v[r][l]);
+    }
+  }
+}
+
+void render::draw_ray(int i, int x, int y) {
+  // already found by the history pass
+  if ((*pidsb)(x, y) == i) return;
+  glm::vec3 dir = prb->get(x, y);
   glm::vec4 tuvi;
+  if (hit(i, cam.get_pos(), dir, &tuvi)) {
+    if ((*pzsb)(x, y) > tuvi.x) {
+      (*pzsb)(x, y) = tuvi.x;
+      (*pidsb)(x, y) = i;
+      (*puvsb)(x, y) = glm::vec2(tuvi.y, tuvi.z);
+    }
+  }
+}
+
+bool render::draw_primitives() {
+  assert(lock);
+  assert(pzsb);
+  if (!nprim) return true;
+  for (int y = 0; y < dy; y += tile_size)
+    for (int x = 0; x < dx; x += tile_size)
+      draw_primitive_tile(tile(x, y, std::min(x + tile_size, dx),
+                               std::min(y + tile_size, dy)));
+  return true;
+}
+
+void render::draw_primitive_tile(const tile& t) {
+  float l = (float)t.x0 - 0.5f;
+  float r = (float)t.x1 - 0.5f;
+  float u = (float)t.y0 - 0.5f;
+  float d = (float)t.y1 - 0.5f;
+  frustum f(cam.get_pos(), top_left + right_step * l - up_step * u,
+            top_left + right_step * r - up_step * u,
+            top_left + right_step * r - up_step * d,
+            top_left + right_step * l - up_step * d);
+  glm::vec3 pos = cam.get_pos();
+  glm::vec3 bmin, bmax;
+  for (int i = 0; i < nprim; ++i) {
+    if (pprim[i].bounds(&bmin, &bmax) && f.cull_box(bmin, bmax)) continue;
+    for (int y = t.y0; y < t.y1; ++y) {
+      for (int x = t.x0; x < t.x1; ++x) {
+        if (!level_pixel(x, y) || !checker_pixel(x, y) || !fovea_pixel(x, y))
+          continue;
+        float h;
+        if (!pprim[i].intersect(pos, prb->get(x, y), 0.0f, (*pzsb)(x, y), &h))
+          continue;
+        (*pzsb)(x, y) = h;
+        (*pidsb)(x, y) = maxobj + i;
+        // the normal is the same for the 3 corners
+        (*puvsb)(x, y) = glm::vec2(0.0f);
+      }
+    }
+  }
+}
+
+bool render::hit(int i, glm::vec3 pos, glm::vec3 dir, glm::vec4* tuvi) {
   glm::vec4 pvd;
+  tri->intersect_det(i, dir, &pvd);
+  if (pvd.w <= std::numeric_limits<float>::epsilon()) return false;
+  return tri->intersect_barycentric(i, pvd, pos, dir, tuvi);
+}
 
-  for (int obji = first; obji <= last; ++obji) {
-    glm::vec4 bound = bound_tri[obji];
-    for (int y = (int)bound.y; y < (int)bound.w; ++y) {
-      glm::vec3 yscanline = top_left - up_step * (float)y;
-      glm::vec3 dir;
-      yscanline += right_step * bound_tri[obji].x;
-      bool found = true;
-      int lastx = (int)bound.x;
-      for (int x = lastx; x < (int)bound.z; ++x) {
-        dir = yscanline;
-        dir = glm::normalize(dir);
-        int index = obji * 3;
-        tri->intersect_det(pib->get(index), pib->get(index + 1),
-                           pib->get(index + 2), pos, dir, &pvd);
-        if (pvd.w > std::numeric_limits<float>::epsilon()) {
-          if (tri->intersect_barycentric(pib->get(index), pib->get(index + 1),
-                                         pib->get(index + 2), pvd, pos, dir,
-                                         &tuvi)) {
-            if (!found)
-              if (x > lastx) lastx = x;
-            found = true;
-            if ((*pzsb)(x, y) > tuvi.x) {
-              (*pzsb)(x, y) = tuvi.x;
-              (*pisb)(x, y) = phong(tuvi, dir, obji);
-            }
-          } else {
-            if (found) {
-              yscanline += right_step;
-              continue;
-            }
-          }
+void render::draw_history(int first, int last) {
+  // screen box of the triangles of the range (no ray outside of it can
+  // hit them), so that each draw call only scans its part of the screen
+  int x0 = dx, y0 = dy, x1 = -1, y1 = -1;
+  for (int i = first; i <= last; ++i) {
+    glm::vec4 bound = bound_tri[i];
+    if ((bound.x < 0.0f) || (bound.y < 0.0f)) continue;
+    x0 = std::min(x0, (int)bound.x);
+    y0 = std::min(y0, (int)bound.y);
+    x1 = std::max(x1, (int)bound.z);
+    y1 = std::max(y1, (int)bound.w);
+  }
+  x1 = std::min(x1, dx - 1);
+  y1 = std::min(y1, dy - 1);
+  glm::vec3 pos = cam.get_pos();
+  glm::vec4 tuvi;
+  for (int y = y0; y <= y1; ++y) {
+    for (int x = x0; x <= x1; ++x) {
+      int obji = (*ppidsb)(x, y);
+      if (obji < first || obji > last) continue;
+      if (!checker_pixel(x, y) || !fovea_pixel(x, y)) continue;
+      ++history_tests;
+      glm::vec3 dir = prb->get(x, y);
+      if (hit(obji, pos, dir, &tuvi)) {
+        ++history_hits;
+        if ((*pzsb)(x, y) > tuvi.x) {
+          (*pzsb)(x, y) = tuvi.x;
+          (*pidsb)(x, y) = obji;
+          (*puvsb)(x, y) = glm::vec2(tuvi.y, tuvi.z);
         }
-        yscanline += right_step;
       }
     }
   }
-  return true;
+}
+
+float render::history_hit_rate() const {
+  if (!history_tests) return 0.0f;
+  return (float)history_hits / (float)history_tests;
+}
+
+float render::occluder_hit_rate() const {
+  if (!occluder_tests) return 0.0f;
+  return (float)occluder_hits / (float)occluder_tests;
+}
+
+float render::reuse_rate() const {
+  if (!reuse_tests) return 0.0f;
+  return (float)reuse_hits / (float)reuse_tests;
+}
+
+void render::set_fovea_radii(float inner, float outer) {
+  assert(inner >= 0.0f);
+  assert(outer > inner);
+  fovea_inner = inner;
+  fovea_outer = outer;
+}
+
+void render::set_target_frame_time(float ms) {
+  assert(ms >= 0.0f);
+  target_ms = ms;
+  if (target_ms <= 0.0f) scale = 1.0f;
 }
 
 void render::clear_buffer() {
-  unsigned int back = 0x00000000;
-  for (int i = 0; i < lcount; ++i) {
-    back += clampRGBA(pl[i].ambiant());
-  }
+  frame_start = now_ms();
+  back = glm::vec4(0.0f);
+  for (int i = 0; i < lcount; ++i) back += pl[i].ambiant();
+  back.w = 0.0f;
+  // keep the distances and the colours of the last frame
+  screen_buffer<float>* ztemp = ppzsb;
+  ppzsb = pzsb;
+  pzsb = ztemp;
   pzsb->clear(std::numeric_limits<float>::max());
-  pisb->clear(back);
+  // (the levels of the progressive mode write their own background)
+  if (!prog_step) {
+    screen_buffer<glm::vec4>* ctemp = pphdr;
+    pphdr = phdr;
+    phdr = ctemp;
+    phdr->clear(back);
+  }
+  // keep the visible triangles of the last frame
+  screen_buffer<int>* temp = ppidsb;
+  ppidsb = pidsb;
+  pidsb = temp;
+  pidsb->clear(-1);
+  history_tests = 0;
+  history_hits = 0;
+  occluder_tests = 0;
+  occluder_hits = 0;
+  reuse_tests = 0;
+  reuse_hits = 0;
 }
 
 void render::present() {
   assert(lock);
   assert(pisb);
 
+  reusing = history_colour && (reuse_age > 0) && !light_samples && !prog_step;
+  if (reusing) reproject();
+  shade();
+  if (checkering) reconstruct_checker();
+  if (foveating) fill_periphery();
+  if (prog_step > 1) fill_progressive();
+  // the next frame can reuse this one if it is complete
+  history_colour = ((reuse_age > 0) || checkerboard) && !light_samples &&
+                   (prog_step <= 1);
+  prev_checkering = checkering;
+  prev_parity = checker_parity;
+  if (checkering) checker_parity ^= 1;
+  prev_pos = cam.get_pos();
+  prev_to = cam.get_to();
+  prev_top_left = top_left;
+  prev_right_step = right_step;
+  prev_up_step = up_step;
+  // (the levels are not averaged)
+  if ((light_samples > 0) && !prog_step) ++acc_frames;
+  if (prog_step) prog_step /= 2;
+  tonemap();
   glClear(GL_COLOR_BUFFER_BIT);
-  glDrawPixels(dx, dy, GL_RGBA, GL_UNSIGNED_BYTE, pisb->pv);
+  glDrawPixels(odx, ody, GL_RGBA, GL_UNSIGNED_BYTE, pisb->pv);
   pw->is_error();
   glFlush();
+  govern();
+}
+
+void render::govern() {
+  // largest change of the scale per frame and change under which the
+  // size is kept (every change restarts the history)
+  const float max_step = 1.25f;
+  const float dead_band = 0.05f;
+  float ms = (float)(now_ms() - frame_start);
+  frame_ms = (frame_ms > 0.0f) ? (frame_ms + ms) * 0.5f : ms;
+  if ((target_ms <= 0.0f) || (frame_ms <= 0.0f)) return;
+  // the time is mostly per pixel (the square of the scale)
+  float f = sqrtf(target_ms / frame_ms);
+  f = std::min(max_step, std::max(1.0f / max_step, f));
+  float s = std::min(1.0f, std::max(min_scale, scale * f));
+  if ((fabsf(s - scale) > dead_band * scale) || (s == 1.0f)) scale = s;
+}
+
+bool render::prev_pixel(glm::vec3 p, float* fx, float* fy) const {
+  assert(fx);
+  assert(fy);
+  // (the forward vector is at 1 on the image plane)
+  glm::vec3 v = p - prev_pos;
+  float f = glm::dot(v, prev_to);
+  if (f <= std::numeric_limits<float>::epsilon()) return false;
+  glm::vec3 d = v * (1.0f / f) - prev_top_left;
+  *fx = glm::dot(d, prev_right_step) *
+        (1.0f / glm::dot(prev_right_step, prev_right_step));
+  *fy = -glm::dot(d, prev_up_step) *
+        (1.0f / glm::dot(prev_up_step, prev_up_step));
+  return true;
+}
+
+void render::reproject() {
+  glm::vec3 pos = cam.get_pos();
+  for (int y = 0; y < dy; ++y) {
+    for (int x = 0; x < dx; ++x) {
+      int id = (*pidsb)(x, y);
+      if (id < 0) continue;
+      ++reuse_tests;
+      glm::vec4& c = (*phdr)(x, y);
+      c.w = -1.0f;
+      // pixel of the hit point in the last frame
+      glm::vec3 p = pos + prb->get(x, y) * (*pzsb)(x, y);
+      float fx, fy;
+      if (!prev_pixel(p, &fx, &fy)) continue;
+      int px = (int)floorf(fx + 0.5f);
+      int py = (int)floorf(fy + 0.5f);
+      if ((px < 0) || (px >= dx) || (py < 0) || (py >= dy)) continue;
+      // same triangle at the same distance
+      if ((*ppidsb)(px, py) != id) continue;
+      float dist = glm::length(p - prev_pos);
+      if (fabsf((*ppzsb)(px, py) - dist) > depth_tolerance * dist) continue;
+      // older than the limit of the pixel (between 1 and reuse_age so
+      // that the pixels are not all shaded again in the same frame)
+      glm::vec4 prev = (*pphdr)(px, py);
+      float limit = (float)(reuse_age -
+                            (int)(hash_uint((unsigned int)(x + y * dx)) %
+                                  (unsigned int)reuse_age));
+      if (prev.w + 1.0f > limit) continue;
+      c = prev;
+      c.w = prev.w + 1.0f;
+      ++reuse_hits;
+    }
+  }
+}
+
+bool render::prev_traced_pixel(float fx, float fy, int* px, int* py) const {
+  assert(px);
+  assert(py);
+  // closest of the 4 pixels around that was traced in the last frame
+  int x0 = (int)floorf(fx);
+  int y0 = (int)floorf(fy);
+  float best = std::numeric_limits<float>::max();
+  for (int k = 0; k < 4; ++k) {
+    int x = x0 + (k & 1);
+    int y = y0 + (k >> 1);
+    if ((x < 0) || (x >= dx) || (y < 0) || (y >= dy)) continue;
+    if (prev_checkering && ((x + y + prev_parity) & 1)) continue;
+    float d = ((float)x - fx) * ((float)x - fx) +
+              ((float)y - fy) * ((float)y - fy);
+    if (d >= best) continue;
+    best = d;
+    *px = x;
+    *py = y;
+  }
+  return best < std::numeric_limits<float>::max();
+}
+
+void render::reconstruct_checker() {
+  const int ox[4] = {-1, 1, 0, 0};
+  const int oy[4] = {0, 0, -1, 1};
+  glm::vec3 pos = cam.get_pos();
+  for (int y = 0; y < dy; ++y) {
+    for (int x = 0; x < dx; ++x) {
+      if (checker_pixel(x, y)) continue;
+      // the traced neighbours
+      int nx[4], ny[4], nid[4];
+      float nz[4];
+      int nn = 0;
+      for (int k = 0; k < 4; ++k) {
+        nx[nn] = x + ox[k];
+        ny[nn] = y + oy[k];
+        if ((nx[nn] < 0) || (nx[nn] >= dx) || (ny[nn] < 0) || (ny[nn] >= dy))
+          continue;
+        nid[nn] = (*pidsb)(nx[nn], ny[nn]);
+        nz[nn] = (*pzsb)(nx[nn], ny[nn]);
+        ++nn;
+      }
+      glm::vec4& c = (*phdr)(x, y);
+      glm::vec3 dir = prb->get(x, y);
+      bool found = false;
+      for (int k = 0; history_colour && (k < nn) && !found; ++k) {
+        if (nid[k] < 0) continue;
+        // the point on the surface of the neighbour seen in the last
+        // frame
+        glm::vec3 p = pos + dir * nz[k];
+        float fx, fy;
+        int px, py;
+        if (!prev_pixel(p, &fx, &fy) ||
+            !prev_traced_pixel(fx, fy, &px, &py))
+          continue;
+        // same triangle at the same distance
+        if ((*ppidsb)(px, py) != nid[k]) continue;
+        float dist = glm::length(p - prev_pos);
+        if (fabsf((*ppzsb)(px, py) - dist) > depth_tolerance * dist) continue;
+        c = (*pphdr)(px, py);
+        (*pidsb)(x, y) = nid[k];
+        (*pzsb)(x, y) = nz[k];
+        found = true;
+      }
+      if (!found) {
+        // the most frequent triangle (the closest one on a tie) and the
+        // neighbours on the same surface
+        int ref = 0;
+        int best = 0;
+        for (int k = 0; k < nn; ++k) {
+          int count = 0;
+          for (int m = 0; m < nn; ++m) count += (nid[m] == nid[k]) ? 1 : 0;
+          if ((count > best) || ((count == best) && (nz[k] < nz[ref]))) {
+            best = count;
+            ref = k;
+          }
+        }
+        glm::vec4 sum(0.0f);
+        float n = 0.0f;
+        for (int k = 0; k < nn; ++k) {
+          if ((nid[k] != nid[ref]) &&
+              ((nid[ref] < 0) ||
+               (fabsf(nz[k] - nz[ref]) > depth_tolerance * nz[ref])))
+            continue;
+          sum += (*phdr)(nx[k], ny[k]);
+          n += 1.0f;
+        }
+        c = sum * (1.0f / n);
+        (*pidsb)(x, y) = nid[ref];
+        (*pzsb)(x, y) = nz[ref];
+      }
+      // not reprojected again
+      c.w = (float)reuse_age;
+    }
+  }
+}
+
+int render::tile_step(const tile& t) const {
+  if (!foveating) return 1;
+  return pfovea[(t.y0 / tile_size) * fovea_tiles + t.x0 / tile_size];
+}
+
+bool render::fovea_pixel(int x, int y) const {
+  if (!foveating) return true;
+  int s = pfovea[(y / tile_size) * fovea_tiles + x / tile_size];
+  return !((x | y) & (s - 1));
+}
+
+void render::build_fovea() {
+  // window to render pixels (dynamic resolution)
+  float kx = (float)dx / (float)odx;
+  float ky = (float)dy / (float)ody;
+  glm::vec2 g(gaze.x * kx, gaze.y * ky);
+  float inner = fovea_inner * ky;
+  float ring = (fovea_outer - fovea_inner) * ky;
+  fovea_tiles = (dx + tile_size - 1) / tile_size;
+  for (int y = 0; y < dy; y += tile_size) {
+    for (int x = 0; x < dx; x += tile_size) {
+      // closest point of the tile
+      glm::vec2 c(std::min(std::max(g.x, (float)x),
+                           (float)std::min(x + tile_size, dx)),
+                  std::min(std::max(g.y, (float)y),
+                           (float)std::min(y + tile_size, dy)));
+      float d = glm::length(c - g);
+      int s = 1;
+      for (float r = inner; (d >= r) && (s < max_fovea_step); r += ring)
+        s *= 2;
+      pfovea[(y / tile_size) * fovea_tiles + x / tile_size] = s;
+    }
+  }
+}
+
+void render::fill_periphery() {
+  for (int ty = 0; ty < dy; ty += tile_size) {
+    for (int tx = 0; tx < dx; tx += tile_size) {
+      int s = pfovea[(ty / tile_size) * fovea_tiles + tx / tile_size];
+      if (s == 1) continue;
+      // the closest pixel of the lattice in the tile (the tiles are
+      // aligned on the coarsest stride)
+      int x1 = std::min(tx + tile_size, dx);
+      int y1 = std::min(ty + tile_size, dy);
+      int xl = (x1 - 1) & ~(s - 1);
+      int yl = (y1 - 1) & ~(s - 1);
+      for (int y = ty; y < y1; ++y) {
+        int ys = std::min((y + s / 2) & ~(s - 1), yl);
+        for (int x = tx; x < x1; ++x) {
+          int xs = std::min((x + s / 2) & ~(s - 1), xl);
+          if ((xs == x) && (ys == y)) continue;
+          (*phdr)(x, y) = (*phdr)(xs, ys);
+          // not reprojected again
+          (*phdr)(x, y).w = (float)reuse_age;
+          // (for the history pass and the upscale)
+          (*pidsb)(x, y) = (*pidsb)(xs, ys);
+          (*pzsb)(x, y) = (*pzsb)(xs, ys);
+        }
+      }
+    }
+  }
+}
+
+void render::fill_progressive() {
+  // the closest pixel of the current level (the last one before the
+  // right and bottom edges)
+  int s = prog_step;
+  int xl = (dx - 1) & ~(s - 1);
+  int yl = (dy - 1) & ~(s - 1);
+  for (int y = 0; y < dy; ++y) {
+    int ys = std::min((y + s / 2) & ~(s - 1), yl);
+    for (int x = 0; x < dx; ++x) {
+      int xs = std::min((x + s / 2) & ~(s - 1), xl);
+      if ((xs != x) || (ys != y)) (*phdr)(x, y) = (*phdr)(xs, ys);
+    }
+  }
+}
+
+void render::shade() {
+  for (int y = 0; y < dy; y += tile_size)
+    for (int x = 0; x < dx; x += tile_size)
+      shade_tile(tile(x, y, std::min(x + tile_size, dx),
+                      std::min(y + tile_size, dy)));
+}
+
+void render::tonemap() {
+  // bands of rows, the calling thread takes the first one (alone below
+  // 2 bands, 640 x 480 included)
+  int nthread = std::max(1, (int)std::thread::hardware_concurrency());
+  nthread = std::min(nthread, std::max(1, odx * ody / tonemap_band));
+  nthread = std::min(nthread, std::max(1, ody / tile_size));
+  if (nthread == 1) {
+    tonemap_rows(0, ody);
+    return;
+  }
+  std::vector<std::thread> workers;
+  for (int t = 1; t < nthread; ++t)
+    workers.push_back(std::thread(&render::tonemap_rows, this,
+                                  ody * t / nthread,
+                                  ody * (t + 1) / nthread));
+  tonemap_rows(0, ody / nthread);
+  for (int t = 0; t < (int)workers.size(); ++t) workers[t].join();
+}
+
+void render::tonemap_rows(int y0, int y1) {
+  // the rows are contiguous in both buffers
+  if ((dx == odx) && (dy == ody)) {
+    tonemap_span(phdr->pv + y0 * odx, pisb->pv + y0 * odx, (y1 - y0) * odx);
+    return;
+  }
+  // one upscaled row at a time (the buffers are bottom up)
+  std::vector<glm::vec4> row(odx);
+  for (int r = y0; r < y1; ++r) {
+    for (int x = 0; x < odx; ++x) row[x] = upscale(x, ody - 1 - r);
+    tonemap_span(&row[0], pisb->pv + r * odx, odx);
+  }
+}
+
+void render::tonemap_span(const glm::vec4* src, unsigned int* dst, int n) {
+  const float4 one(1.0f);
+  const float4 scale(exposure);
+  bool reinhard = (tonemap_op == tonemap_reinhard);
+  for (int i = 0; i < n; i += 4) {
+    // the last pixel is repeated past the end
+    glm::vec4 last[4];
+    const glm::vec4* p = src + i;
+    if (i + 4 > n) {
+      for (int k = 0; k < 4; ++k) last[k] = src[std::min(i + k, n - 1)];
+      p = last;
+    }
+    float4 r = float4::load(&p[0].x);
+    float4 g = float4::load(&p[1].x);
+    float4 b = float4::load(&p[2].x);
+    float4 a = float4::load(&p[3].x);
+    transpose(r, g, b, a);
+    r = r * scale;
+    g = g * scale;
+    b = b * scale;
+    if (reinhard) {
+      r = r / (one + r);
+      g = g / (one + g);
+      b = b / (one + b);
+    }
+    if (i + 4 <= n) {
+      pack_rgb(r, g, b, dst + i);
+      continue;
+    }
+    unsigned int out[4];
+    pack_rgb(r, g, b, out);
+    for (int k = i; k < n; ++k) dst[k] = out[k - i];
+  }
+}
+
+glm::vec4 render::upscale(int x, int y) const {
+  // position in the rendered image (pixel centres)
+  float fx = ((float)x + 0.5f) * ((float)dx / (float)odx) - 0.5f;
+  float fy = ((float)y + 0.5f) * ((float)dy / (float)ody) - 0.5f;
+  int x0 = std::min(std::max((int)floorf(fx), 0), dx - 1);
+  int y0 = std::min(std::max((int)floorf(fy), 0), dy - 1);
+  int x1 = std::min(x0 + 1, dx - 1);
+  int y1 = std::min(y0 + 1, dy - 1);
+  float wx = std::min(std::max(fx - (float)x0, 0.0f), 1.0f);
+  float wy = std::min(std::max(fy - (float)y0, 0.0f), 1.0f);
+  // the closest sample decides the surface of the pixel
+  int nx = (wx < 0.5f) ? x0 : x1;
+  int ny = (wy < 0.5f) ? y0 : y1;
+  int id = (*pidsb)(nx, ny);
+  float z = (*pzsb)(nx, ny);
+  int sx[4] = {x0, x1, x0, x1};
+  int sy[4] = {y0, y0, y1, y1};
+  float w[4] = {(1.0f - wx) * (1.0f - wy), wx * (1.0f - wy),
+                (1.0f - wx) * wy, wx * wy};
+  glm::vec4 c(0.0f);
+  float sum = 0.0f;
+  for (int k = 0; k < 4; ++k) {
+    if ((*pidsb)(sx[k], sy[k]) != id) {
+      // another triangle of the same surface (the background has no
+      // distance)
+      float zk = (*pzsb)(sx[k], sy[k]);
+      if ((id < 0) || (fabsf(zk - z) > depth_tolerance * z)) continue;
+    }
+    c += (*phdr)(sx[k], sy[k]) * w[k];
+    sum += w[k];
+  }
+  // (the closest sample has a weight of at least 1/4)
+  return c * (1.0f / sum);
+}
+
+void render::shade_tile(const tile& t) {
+  // largest difference of the corner colours of an interpolated cell
+  const float colour_tolerance = 1.0f / 16.0f;
+  glm::vec3 pos = cam.get_pos();
+  shade_batch& b = *psb;
+  b.n = 0;
+  b.x0 = t.x0;
+  b.y0 = t.y0;
+  b.x1 = t.x1;
+  b.y1 = t.y1;
+  // uniform cells (corners at multiples of r and on the last row and
+  // column of the tile), only their corners are shaded
+  int w = t.x1 - t.x0;
+  int h = t.y1 - t.y0;
+  int r = (light_samples || prog_step || reusing || checkering ||
+           (tile_step(t) > 1))
+              ? 1
+              : shading_rate;
+  int ncx = ((r > 1) && (w > 1)) ? (w - 1 + r - 1) / r : 0;
+  int ncy = ((r > 1) && (h > 1)) ? (h - 1 + r - 1) / r : 0;
+  for (int i = 0; i < tile_size * tile_size; ++i) b.cell[i] = -1;
+  for (int cy = 0; cy < ncy; ++cy) {
+    int cy0 = cy * r;
+    int cy1 = std::min(cy0 + r, h - 1);
+    for (int cx = 0; cx < ncx; ++cx) {
+      int cx0 = cx * r;
+      int cx1 = std::min(cx0 + r, w - 1);
+      if (!uniform_cell(t.x0 + cx0, t.y0 + cy0, t.x0 + cx1, t.y0 + cy1))
+        continue;
+      for (int y = cy0; y <= cy1; ++y)
+        for (int x = cx0; x <= cx1; ++x)
+          if (((x != cx0) && (x != cx1)) || ((y != cy0) && (y != cy1)))
+            b.cell[y * tile_size + x] = cy * ncx + cx;
+    }
+  }
+  // gather the samples to shade and the box around all the visible
+  // points
+  glm::vec3 bmin(std::numeric_limits<float>::max());
+  glm::vec3 bmax(-std::numeric_limits<float>::max());
+  for (int y = t.y0; y < t.y1; ++y) {
+    for (int x = t.x0; x < t.x1; ++x) {
+      int p = (y - t.y0) * tile_size + (x - t.x0);
+      b.slot[p] = -1;
+      if (!level_pixel(x, y) || !checker_pixel(x, y) || !fovea_pixel(x, y))
+        continue;
+      if ((*pidsb)(x, y) < 0) {
+        if (prog_step) (*phdr)(x, y) = back;
+        continue;
+      }
+      glm::vec3 hit = pos + prb->get(x, y) * (*pzsb)(x, y);
+      bmin = glm::min(bmin, hit);
+      bmax = glm::max(bmax, hit);
+      // (reprojected)
+      if (reusing && ((*phdr)(x, y).w >= 0.0f)) continue;
+      if (b.cell[p] < 0) push_sample(b, x, y);
+    }
+  }
+  if (!b.n) return;
+  build_tile_lights(bmin, bmax);
+  if (shadows) {
+    // (the primitives have no light classes)
+    if (!light_classes || nprim) build_shadow_candidates(bmin, bmax);
+    for (int q = 0; q < ntl; ++q) pocc[ptl[q]].clear();
+  }
+  shade_samples(b);
+  if (!ncx || !ncy) return;
+
+  // cells whose corners disagree (shadow edge, highlight) are shaded
+  // at full rate
+  bool full[max_coarse];
+  for (int cy = 0; cy < ncy; ++cy) {
+    int y0 = t.y0 + cy * r;
+    int y1 = t.y0 + std::min(cy * r + r, h - 1);
+    for (int cx = 0; cx < ncx; ++cx) {
+      int x0 = t.x0 + cx * r;
+      int x1 = t.x0 + std::min(cx * r + r, w - 1);
+      glm::vec3 c[4] = {
+          glm::vec3((*phdr)(x0, y0)), glm::vec3((*phdr)(x1, y0)),
+          glm::vec3((*phdr)(x0, y1)), glm::vec3((*phdr)(x1, y1))};
+      glm::vec3 d = glm::max(glm::max(c[0], c[1]), glm::max(c[2], c[3])) -
+                    glm::min(glm::min(c[0], c[1]), glm::min(c[2], c[3]));
+      full[cy * ncx + cx] =
+          (std::max(std::max(d.x, d.y), d.z) > colour_tolerance);
+    }
+  }
+  b.n = 0;
+  for (int y = t.y0; y < t.y1; ++y) {
+    for (int x = t.x0; x < t.x1; ++x) {
+      int p = (y - t.y0) * tile_size + (x - t.x0);
+      b.slot[p] = -1;
+      if ((b.cell[p] < 0) || !full[b.cell[p]]) continue;
+      b.cell[p] = -1;
+      push_sample(b, x, y);
+    }
+  }
+  if (b.n) shade_samples(b);
+
+  // bilinear between the corners for the others
+  for (int y = t.y0; y < t.y1; ++y) {
+    for (int x = t.x0; x < t.x1; ++x) {
+      int c = b.cell[(y - t.y0) * tile_size + (x - t.x0)];
+      if (c < 0) continue;
+      int cx0 = (c % ncx) * r;
+      int cy0 = (c / ncx) * r;
+      int cx1 = std::min(cx0 + r, w - 1);
+      int cy1 = std::min(cy0 + r, h - 1);
+      float fx = (float)(x - t.x0 - cx0) / (float)(cx1 - cx0);
+      float fy = (float)(y - t.y0 - cy0) / (float)(cy1 - cy0);
+      float wc[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy),
+                     (1.0f - fx) * fy, fx * fy};
+      (*phdr)(x, y) = (*phdr)(t.x0 + cx0, t.y0 + cy0) * wc[0] +
+                      (*phdr)(t.x0 + cx1, t.y0 + cy0) * wc[1] +
+                      (*phdr)(t.x0 + cx0, t.y0 + cy1) * wc[2] +
+                      (*phdr)(t.x0 + cx1, t.y0 + cy1) * wc[3];
+    }
+  }
+}
+
+int render::push_sample(shade_batch& b, int x, int y) {
+  int k = b.n++;
+  b.slot[(y - b.y0) * tile_size + (x - b.x0)] = k;
+  glm::vec2 uv = (*puvsb)(x, y);
+  glm::vec3 dir = prb->get(x, y);
+  b.x[k] = x;
+  b.y[k] = y;
+  b.id[k] = (*pidsb)(x, y);
+  b.t[k] = (*pzsb)(x, y);
+  b.u[k] = uv.x;
+  b.v[k] = uv.y;
+  b.dx[k] = dir.x;
+  b.dy[k] = dir.y;
+  b.dz[k] = dir.z;
+  return k;
+}
+
+void render::shade_samples(shade_batch& b) {
+  // pad with the last sample
+  for (int k = b.n; k & 3; ++k) {
+    b.x[k] = b.x[k - 1];
+    b.y[k] = b.y[k - 1];
+    b.id[k] = b.id[k - 1];
+    b.t[k] = b.t[k - 1];
+    b.u[k] = b.u[k - 1];
+    b.v[k] = b.v[k - 1];
+    b.dx[k] = b.dx[k - 1];
+    b.dy[k] = b.dy[k - 1];
+    b.dz[k] = b.dz[k - 1];
+  }
+  (this->*pphong)(b);
+  for (int k = 0; k < b.n; ++k)
+    (*phdr)(b.x[k], b.y[k]) = glm::vec4(b.ar[k], b.ag[k], b.ab[k], 0.0f);
+}
+
+bool render::uniform_cell(int x0, int y0, int x1, int y1) {
+  const float normal_tolerance = 0.995f;
+  // a single triangle
+  int id = (*pidsb)(x0, y0);
+  if (id < 0) return false;
+  for (int y = y0; y <= y1; ++y)
+    for (int x = x0; x <= x1; ++x)
+      if ((*pidsb)(x, y) != id) return false;
+  // (primitives are smooth, the corners are compared below)
+  int cx[4] = {x0, x1, x0, x1};
+  int cy[4] = {y0, y0, y1, y1};
+  glm::vec3 n[4];
+  if (is_primitive(id)) {
+    glm::vec3 pos = cam.get_pos();
+    for (int i = 0; i < 4; ++i)
+      n[i] = pprim[id - maxobj].normal(
+          pos + prb->get(cx[i], cy[i]) * (*pzsb)(cx[i], cy[i]), pos);
+    return (glm::dot(n[0], n[3]) >= normal_tolerance) &&
+           (glm::dot(n[1], n[2]) >= normal_tolerance);
+  }
+  // close normals at the corners
+  const tri_record& rec = tri->get_record(id);
+  glm::vec3 n0 = pvb->get_normal(rec.vi[0]);
+  glm::vec3 n1 = pvb->get_normal(rec.vi[1]);
+  glm::vec3 n2 = pvb->get_normal(rec.vi[2]);
+  for (int i = 0; i < 4; ++i) {
+    glm::vec2 uv = (*puvsb)(cx[i], cy[i]);
+    n[i] = glm::normalize(n0 * (1.0f - uv.x - uv.y) + n1 * uv.x + n2 * uv.y);
+  }
+  return (glm::dot(n[0], n[3]) >= normal_tolerance) &&
+         (glm::dot(n[1], n[2]) >= normal_tolerance);
+}
+
+void render::build_tile_lights(glm::vec3 bmin, glm::vec3 bmax) {
+  // light spheres against the box of the visible points of the tile
+  ntl = 0;
+  for (int j = 0; j < lcount; ++j) {
+    float r = pl[j].range();
+    if (r > 0.0f) {
+      glm::vec3 lpos = pl[j].position();
+      glm::vec3 d =
+          glm::max(glm::max(bmin - lpos, lpos - bmax), glm::vec3(0.0f));
+      if (glm::dot(d, d) >= r * r) continue;
+    }
+    ptl[ntl++] = j;
+  }
+}
+
+void render::build_shadow_candidates(glm::vec3 bmin, glm::vec3 bmax) {
+  int nb_tri = pib->size() / 3;
+  glm::vec3 p0, p1, p2;
+  for (int q = 0; q < ntl; ++q) {
+    int j = ptl[q];
+    // only the triangles in the beam from the light to the tile can
+    // cast a shadow on it
+    int* pc = pcand + j * maxobj;
+    int n = 0;
+    if (pl[j].technique() != shadow_ray) {
+      pncand[j] = 0;
+      continue;
+    }
+    frustum f(pl[j].position(), bmin, bmax);
+    for (int c = 0; c * chunk_size < nb_tri; ++c) {
+      if (f.cull_box(pchunk[c * 2], pchunk[c * 2 + 1])) continue;
+      int clast = std::min(nb_tri, c * chunk_size + chunk_size);
+      for (int i = c * chunk_size; i < clast; ++i) {
+        if (f.cull_box(pbox[i * 2], pbox[i * 2 + 1])) continue;
+        get_triangle(i, &p0, &p1, &p2);
+        if (f.cull_triangle(p0, p1, p2)) continue;
+        pc[n++] = i;
+      }
+    }
+    pncand[j] = n;
+  }
 }
 
 int render::add_light(const light& l) {
@@ -255,107 +1363,597 @@ int render::add_light(const light& l) {
     pl = new light[1];
   }
   pl[lcount] = l;
+  // room for the shadow candidates of the new light
+  if (pcand) delete[] pcand;
+  if (pncand) delete[] pncand;
+  if (pocc) delete[] pocc;
+  if (psm) delete[] psm;
+  if (ptl) delete[] ptl;
+  pcand = new int[(lcount + 1) * maxobj];
+  pncand = new int[lcount + 1];
+  pocc = new occluder_cache[lcount + 1];
+  psm = new shadow_map[lcount + 1];
+  ptl = new int[lcount + 1];
+  assert(ptl);
+  assert(pcand);
+  assert(pncand);
+  assert(pocc);
+  assert(psm);
+  ++light_version;
   return ++lcount;
 }
 
-unsigned int render::clampRGBA(glm::vec4 v) {
-  int ir = (int)(v.x * 256.0f);
-  if (ir < 0) ir = 0;
-  if (ir > 255) ir = 255;
+int render::add_primitive(const primitive& p) {
+  assert(!lock);
+  primitive* temp = new primitive[nprim + 1];
+  assert(temp);
+  for (int i = 0; i < nprim; ++i) temp[i] = pprim[i];
+  if (pprim) delete[] pprim;
+  pprim = temp;
+  pprim[nprim] = p;
+  restart();
+  return nprim++;
+}
+
+void render::set_primitive(int i, const primitive& p) {
+  assert(!lock);
+  assert(i >= 0);
+  assert(i < nprim);
+  pprim[i] = p;
+  restart();
+}
+
+void render::clear_primitives() {
+  assert(!lock);
+  if (pprim) delete[] pprim;
+  pprim = 0;
+  nprim = 0;
+  restart();
+}
+
+void render::set_light(int i, const light& l) {
+  assert(!lock);
+  assert(i >= 0);
+  assert(i < lcount);
+  pl[i] = l;
+  ++light_version;
+}
 
-  int ig = (int)(v.y * 256.0f);
-  if (ig < 0) ig = 0;
-  if (ig > 255) ig = 255;
+void render::set_shadow_technique(int i, shadow_technique t) {
+  assert(!lock);
+  assert(i >= 0);
+  assert(i < lcount);
+  pl[i].set_technique(t);
+  restart();
+}
+
+void render::set_shadow_map_size(int s) {
+  assert(s > 0);
+  shadow_map_size = s;
+  restart();
+}
 
-  int ib = (int)(v.z * 256.0f);
-  if (ib < 0) ib = 0;
-  if (ib > 255) ib = 255;
+void render::set_bake_texel_size(float t) {
+  assert(t > 0.0f);
+  bake_texel = t;
+  restart();
+}
 
-  int ia = (int)(v.w * 256.0f);
-  if (ia < 0) ia = 0;
-  if (ia > 255) ia = 255;
+void render::set_sdf_voxel_size(float v) {
+  assert(v > 0.0f);
+  sdf_voxel = v;
+  restart();
+}
 
-  return (ib << 16) + (ig << 8) + ir;
+bool render::shadowed(int j, int i, glm::vec3 hitpoint, glm::vec3 l) {
+  occluder_cache& oc = pocc[j];
+  float tmin = std::numeric_limits<float>::epsilon();
+  float tmax = glm::length(pl[j].position() - hitpoint) - tmin;
+  ++occluder_tests;
+  // last occluders of this tile first
+  for (int c = 0; c < oc.size(); ++c) {
+    int k = oc.get(c);
+    if (k == i) continue;
+    if (tri->shadow_hit(k, hitpoint, l, tmin, tmax)) {
+      oc.touch(k);
+      ++occluder_hits;
+      return true;
+    }
+  }
+  // triangles that can occlude i or the ones in the tile beam
+  const int* pc;
+  int nc;
+  if (light_classes && !is_primitive(i)) {
+    pc = plc->candidates(j, i, &nc);
+  } else {
+    pc = pcand + j * maxobj;
+    nc = pncand[j];
+  }
+  for (int n = 0; n < nc; ++n) {
+    int k = pc[n];
+    if (k == i || oc.contains(k)) continue;
+    if (tri->shadow_hit(k, hitpoint, l, tmin, tmax)) {
+      oc.touch(k);
+      return true;
+    }
+  }
+  return primitive_shadowed(j, i, hitpoint, l);
 }
 
-unsigned int render::phong(glm::vec4 tuvi, glm::vec3 dir, int i) {
+bool render::primitive_shadowed(int j, int i, glm::vec3 hitpoint,
+                                glm::vec3 l) {
+  float tmin = std::numeric_limits<float>::epsilon();
+  float tmax = glm::length(pl[j].position() - hitpoint) - tmin;
+  float h;
+  for (int m = 0; m < nprim; ++m)
+    if ((maxobj + m != i) && pprim[m].intersect(hitpoint, l, tmin, tmax, &h))
+      return true;
+  return false;
+}
+
+bool render::sample_lit(int j, const shade_batch& b, int k) {
+  if (light_classes && !is_primitive(b.id[k])) {
+    light_class c = plc->get(j, b.id[k]);
+    // no triangle can occlude it
+    if (c == class_lit)
+      return !primitive_shadowed(j, b.id[k],
+                                 glm::vec3(b.px[k], b.py[k], b.pz[k]),
+                                 glm::vec3(b.lx[k], b.ly[k], b.lz[k]));
+    // backfacing the light everywhere
+    if (c == class_unlit) return false;
+  }
+  return !shadowed(j, b.id[k], glm::vec3(b.px[k], b.py[k], b.pz[k]),
+                   glm::vec3(b.lx[k], b.ly[k], b.lz[k]));
+}
+
+void render::coarse_shadows(int j, shade_batch& b) {
+  int r = shadow_rate;
+  int cdx = (b.x1 - b.x0 + r - 1) / r + 1;
+  int cdy = (b.y1 - b.y0 + r - 1) / r + 1;
+  // trace the coarse samples (the last row and column on the tile edge)
+  for (int cy = 0; cy < cdy; ++cy) {
+    int y = std::min(cy * r, b.y1 - b.y0 - 1);
+    for (int cx = 0; cx < cdx; ++cx) {
+      int x = std::min(cx * r, b.x1 - b.x0 - 1);
+      int k = b.slot[y * tile_size + x];
+      int c = -1;
+      if ((k >= 0) && (b.vis[k] != 0.0f)) c = sample_lit(j, b, k) ? 1 : 0;
+      b.coarse[cy * cdx + cx] = c;
+    }
+  }
+  for (int k = 0; k < b.n; ++k) {
+    if (b.vis[k] == 0.0f) continue;
+    int x = b.x[k] - b.x0;
+    int y = b.y[k] - b.y0;
+    int cx = x / r;
+    int cy = y / r;
+    int lit = 0;
+    int dark = 0;
+    if (!(x % r) && !(y % r)) {
+      // a coarse sample
+      if (b.coarse[cy * cdx + cx] >= 0) {
+        if (!b.coarse[cy * cdx + cx]) b.vis[k] = 0.0f;
+        continue;
+      }
+    } else {
+      // the 4 coarse samples around that are on the same surface
+      for (int c = 0; c < 4; ++c) {
+        int ccx = cx + (c & 1);
+        int ccy = cy + (c >> 1);
+        int v = b.coarse[ccy * cdx + ccx];
+        if (v < 0) continue;
+        int kc = b.slot[std::min(ccy * r, b.y1 - b.y0 - 1) * tile_size +
+                        std::min(ccx * r, b.x1 - b.x0 - 1)];
+        if ((b.id[kc] != b.id[k]) &&
+            (fabs(b.t[kc] - b.t[k]) > depth_tolerance * b.t[k]))
+          continue;
+        if (v)
+          ++lit;
+        else
+          ++dark;
+      }
+    }
+    // agreement, otherwise trace at full resolution
+    if ((lit + dark >= 2) && !(lit && dark)) {
+      if (dark) b.vis[k] = 0.0f;
+    } else if (!sample_lit(j, b, k)) {
+      b.vis[k] = 0.0f;
+    }
+  }
+}
+
+void render::set_reprojection(int max_age) {
+  assert(max_age >= 0);
+  reuse_age = max_age;
+  restart();
+}
+
+void render::set_shading_rate(int r) {
+  assert((r == 1) || (r == 2) || (r == 4));
+  shading_rate = r;
+  restart();
+}
+
+void render::set_shadow_rate(int r) {
+  assert((r == 1) || (r == 2) || (r == 4));
+  shadow_rate = r;
+  restart();
+}
+
+void render::set_light_samples(int n) {
+  assert(n >= 0);
+  light_samples = n;
+  restart();
+}
+
+glm::vec3 render::face_normal(const shade_batch& b, int k) {
+  // exact for the primitives
+  if (is_primitive(b.id[k])) return glm::vec3(b.nx[k], b.ny[k], b.nz[k]);
+  // the winding does not always follow the vertex normals, keep the side
+  // of the shading normal
+  glm::vec3 n = glm::normalize(tri->get_record(b.id[k]).normal);
+  if (b.nx[k] * n.x + b.ny[k] * n.y + b.nz[k] * n.z < 0.0f) n = -n;
+  return n;
+}
+
+template <bool SHADOWS, bool MULTI_LIGHT, bool VERTEX_COLOUR, bool SPECULAR>
+void render::phong(shade_batch& b) {
   assert(tri);
-  assert(pib);
-  assert(i >= 0);
-  assert(i < (pib->size() / 3));
+  assert(pvb);
   assert(lcount > 0);
+  assert(b.n > 0);
 
-  glm::vec4 col(0.0f, 0.0f, 0.0f, 0.0f);
-  int v0, v1, v2;
-  v0 = pib->get(i * 3);
-  v1 = pib->get(i * 3 + 1);
-  v2 = pib->get(i * 3 + 2);
-  glm::vec3 normal = tri->intersect_normal(v0, v1, v2, tuvi);
-  glm::vec3 hitpoint = cam.get_pos() + dir * tuvi.x;
+  int n4 = (b.n + 3) & ~3;
+  // vertex attributes of the visible triangles
+  glm::vec3 pos = cam.get_pos();
+  for (int k = 0; k < n4; ++k) {
+    if (is_primitive(b.id[k])) {
+      // the same normal and colour on the 3 corners
+      const primitive& pr = pprim[b.id[k] - maxobj];
+      glm::vec3 p = pos + glm::vec3(b.dx[k], b.dy[k], b.dz[k]) * b.t[k];
+      glm::vec3 norm = pr.normal(p, pos);
+      glm::vec3 col = pr.colour();
+      for (int c = 0; c < 3; ++c) {
+        for (int e = 0; e < 3; ++e) b.vn[c][e][k] = norm[e];
+        if (VERTEX_COLOUR)
+          for (int e = 0; e < 3; ++e) b.vc[c][e][k] = col[e];
+      }
+      b.cr[k] = col.x;
+      b.cg[k] = col.y;
+      b.cb[k] = col.z;
+      continue;
+    }
+    const tri_record& r = tri->get_record(b.id[k]);
+    for (int c = 0; c < 3; ++c) {
+      glm::vec3 norm = pvb->get_normal(r.vi[c]);
+      for (int e = 0; e < 3; ++e) b.vn[c][e][k] = norm[e];
+      if (!VERTEX_COLOUR) continue;
+      glm::vec3 col = pvb->get_color(r.vi[c]);
+      for (int e = 0; e < 3; ++e) b.vc[c][e][k] = col[e];
+    }
+    // one colour per triangle
+    if (!VERTEX_COLOUR) {
+      glm::vec3 col = pvb->get_color(r.vi[0]);
+      b.cr[k] = col.x;
+      b.cg[k] = col.y;
+      b.cb[k] = col.z;
+    }
+  }
 
-  // search light
-  for (int j = 0; j < lcount; ++j) {
-    glm::vec3 incoming_light_normal =
-        glm::normalize(pl[j].position() - hitpoint);
-    bool visible = true;
-    float n_cross_inlt = glm::dot(normal, incoming_light_normal);
-    // if the angle is too sharp or behind target
-    if (n_cross_inlt < std::numeric_limits<float>::epsilon()) visible = false;
-#ifndef WITHOUT_SHADOW
-    if (visible) {
-      int last_occulted = pl[j].last_hit();
-      if (last_occulted != i && last_occulted != -1) {
-        int u0, u1, u2;
-        u0 = pib->get(last_occulted * 3);
-        u1 = pib->get(last_occulted * 3 + 1);
-        u2 = pib->get(last_occulted * 3 + 2);
-        // CHECKME(anirul): I don't get why there is a sqrt here.
-        if (tri->shadow_hit(u0, u1, u2, hitpoint, incoming_light_normal,
-                            std::numeric_limits<float>::epsilon(),
-                            std::sqrt(glm::dot((hitpoint - pl[j].position()),
-                                               (hitpoint - pl[j].position())) -
-                                      std::numeric_limits<float>::epsilon()))) {
-          visible = false;
-        }
+  // interpolated normal, colour and hit point
+  const float4 zero(0.0f);
+  const float4 one(1.0f);
+  for (int k = 0; k < n4; k += 4) {
+    float4 u = float4::load(b.u + k);
+    float4 v = float4::load(b.v + k);
+    float4 w = one - u - v;
+    float4 t = float4::load(b.t + k);
+    float* pn[3] = {b.nx, b.ny, b.nz};
+    float* pc[3] = {b.cr, b.cg, b.cb};
+    for (int e = 0; e < 3; ++e) {
+      (float4::load(b.vn[0][e] + k) * w + float4::load(b.vn[1][e] + k) * u +
+       float4::load(b.vn[2][e] + k) * v)
+          .store(pn[e] + k);
+      if (!VERTEX_COLOUR) continue;
+      (float4::load(b.vc[0][e] + k) * w + float4::load(b.vc[1][e] + k) * u +
+       float4::load(b.vc[2][e] + k) * v)
+          .store(pc[e] + k);
+    }
+    (float4(pos.x) + float4::load(b.dx + k) * t).store(b.px + k);
+    (float4(pos.y) + float4::load(b.dy + k) * t).store(b.py + k);
+    (float4(pos.z) + float4::load(b.dz + k) * t).store(b.pz + k);
+    zero.store(b.ar + k);
+    zero.store(b.ag + k);
+    zero.store(b.ab + k);
+    zero.store(b.sr + k);
+    zero.store(b.sg + k);
+    zero.store(b.sb + k);
+    one.store(b.ao + k);
+  }
+  if (ptexture) texture_batch(b);
+  // view independent part already done
+  if (baked_lighting) {
+    glm::vec4 amb(0.0f);
+    for (int j = 0; j < lcount; ++j) amb += pl[j].ambiant();
+    for (int k = 0; k < n4; ++k) {
+      glm::vec3 irr = is_primitive(b.id[k])
+                          ? glm::vec3(amb)
+                          : pbk->irradiance(b.id[k], b.u[k], b.v[k]);
+      b.ar[k] = irr.x;
+      b.ag[k] = irr.y;
+      b.ab[k] = irr.z;
+    }
+  }
+  if (ambient_occlusion)
+    for (int k = 0; k < b.n; ++k)
+      b.ao[k] = pdf->occlusion(glm::vec3(b.px[k], b.py[k], b.pz[k]),
+                               face_normal(b, k));
+
+  // a few lights picked per pixel (the baked lighting already has
+  // the diffuse of every light)
+  bool sampled = (light_samples > 0) && !baked_lighting;
+  if (sampled) sample_lights<SHADOWS>(b);
+
+  // ambiant of the lights that do not reach the tile
+  if (!sampled && !baked_lighting && (ntl < lcount)) {
+    glm::vec4 amb(0.0f);
+    if (!MULTI_LIGHT) amb = pl[0].ambiant();
+    for (int j = 0, q = 0; MULTI_LIGHT && (j < lcount); ++j) {
+      if ((q < ntl) && (ptl[q] == j)) {
+        ++q;
+        continue;
       }
-      if (visible) {
-        for (int k = 0; k < (pib->size() / 3); ++k) {
-          if (k != last_occulted && k != i) {
-            int u0, u1, u2;
-            u0 = pib->get(k * 3);
-            u1 = pib->get(k * 3 + 1);
-            u2 = pib->get(k * 3 + 2);
-            if (tri->shadow_hit(u0, u1, u2, hitpoint, incoming_light_normal,
-                                std::numeric_limits<float>::epsilon(),
-                                1000.0f))  // TODO (faster than sqrt)
-            {
-              visible = false;
-              pl[j].last_hit() = k;
-              break;
-            }
-          }
-        }
+      amb += pl[j].ambiant();
+    }
+    for (int k = 0; k < n4; k += 4) {
+      float4 ao = float4::load(b.ao + k);
+      (float4::load(b.ar + k) + ao * amb.x).store(b.ar + k);
+      (float4::load(b.ag + k) + ao * amb.y).store(b.ag + k);
+      (float4::load(b.ab + k) + ao * amb.z).store(b.ab + k);
+    }
+  }
+
+  // search light (the ones reaching the tile)
+  const float4 eps(std::numeric_limits<float>::epsilon());
+  // should be in material (structure)
+  const float4 spec_start(0.90f);
+  const float4 spec_scale(10.0f);
+  // (the sampled lights are already done)
+  int nq = sampled ? 0 : ntl;
+  for (int q = 0; q < nq; ++q) {
+    int j = MULTI_LIGHT ? ptl[q] : 0;
+    glm::vec3 lpos = pl[j].position();
+    float range = pl[j].range();
+    float4 inv_range2(range > 0.0f ? 1.0f / (range * range) : 0.0f);
+    for (int k = 0; k < n4; k += 4) {
+      float4 lx = float4(lpos.x) - float4::load(b.px + k);
+      float4 ly = float4(lpos.y) - float4::load(b.py + k);
+      float4 lz = float4(lpos.z) - float4::load(b.pz + k);
+      float4 len2 = lx * lx + ly * ly + lz * lz;
+      float4 inv_len = one / sqrt(len2);
+      lx = lx * inv_len;
+      ly = ly * inv_len;
+      lz = lz * inv_len;
+      float4 ndl = float4::load(b.nx + k) * lx +
+                   float4::load(b.ny + k) * ly + float4::load(b.nz + k) * lz;
+      lx.store(b.lx + k);
+      ly.store(b.ly + k);
+      lz.store(b.lz + k);
+      ndl.store(b.ndl + k);
+      // if the angle is too sharp or behind target
+      float4 vis = select(ndl >= eps, one, zero);
+      if (range > 0.0f) {
+        // attenuation (see light::attenuation)
+        float4 a = max(one - len2 * inv_range2, zero);
+        vis = vis * a * a;
       }
+      vis.store(b.vis + k);
     }
-#endif  // WITHOUT_SHADOW
-    if (visible) {
-      // should be in material (structure)
-      if (n_cross_inlt > 0.90f) {
-        col += pl[j].ambiant();
-        col += pl[j].diffuse() * n_cross_inlt;
-        col *= tri->intersect_col(v0, v1, v2, tuvi);
-        col += ((n_cross_inlt - 0.90f) * 10.0f) * pl[j].specular();
+    if (SHADOWS) {
+      if (baked_lighting) {
+        // baked visibility (only for the specular)
+        for (int k = 0; k < b.n; ++k) {
+          if (b.vis[k] == 0.0f) continue;
+          if (!is_primitive(b.id[k]))
+            b.vis[k] *= pbk->visibility(j, b.id[k], b.u[k], b.v[k]);
+          else if (!sample_lit(j, b, k))
+            b.vis[k] = 0.0f;
+        }
+      } else if (pl[j].technique() == shadow_map_cube) {
+        for (int k = 0; k < b.n; ++k)
+          if (b.vis[k] != 0.0f)
+            b.vis[k] *= psm[j].visibility(
+                glm::vec3(b.px[k], b.py[k], b.pz[k]), b.id[k], b.ndl[k]);
+      } else if (pl[j].technique() == shadow_sdf) {
+        for (int k = 0; k < b.n; ++k) {
+          if (b.vis[k] == 0.0f) continue;
+          b.vis[k] *= pdf->cone_visibility(
+              glm::vec3(b.px[k], b.py[k], b.pz[k]), face_normal(b, k), lpos,
+              pl[j].radius());
+        }
+      } else if (shadow_rate > 1) {
+        coarse_shadows(j, b);
       } else {
-        col += pl[j].ambiant();
-        col += pl[j].diffuse() * n_cross_inlt;
-        col *= tri->intersect_col(v0, v1, v2, tuvi);
+        for (int k = 0; k < b.n; ++k)
+          if ((b.vis[k] != 0.0f) && !sample_lit(j, b, k)) b.vis[k] = 0.0f;
       }
-    } else {
-      col += pl[j].ambiant();
-      col *= tri->intersect_col(v0, v1, v2, tuvi);
+    }
+    glm::vec4 amb = pl[j].ambiant();
+    glm::vec4 diff = pl[j].diffuse();
+    glm::vec4 spec = pl[j].specular();
+    for (int k = 0; k < n4; k += 4) {
+      float4 vis = float4::load(b.vis + k);
+      float4 ndl = float4::load(b.ndl + k);
+      float4 ao = float4::load(b.ao + k);
+      float4 vd = vis * ndl;
+      if (!baked_lighting) {
+        (float4::load(b.ar + k) + ao * amb.x + vd * diff.x).store(b.ar + k);
+        (float4::load(b.ag + k) + ao * amb.y + vd * diff.y).store(b.ag + k);
+        (float4::load(b.ab + k) + ao * amb.z + vd * diff.z).store(b.ab + k);
+      }
+      if (!SPECULAR) continue;
+      float4 vs = vis * max(ndl - spec_start, zero) * spec_scale;
+      (float4::load(b.sr + k) + vs * spec.x).store(b.sr + k);
+      (float4::load(b.sg + k) + vs * spec.y).store(b.sg + k);
+      (float4::load(b.sb + k) + vs * spec.z).store(b.sb + k);
+    }
+  }
+
+  // linear colour (quantized by the tonemap)
+  for (int k = 0; k < n4; k += 4) {
+    float4 r = float4::load(b.ar + k) * float4::load(b.cr + k);
+    float4 g = float4::load(b.ag + k) * float4::load(b.cg + k);
+    float4 bl = float4::load(b.ab + k) * float4::load(b.cb + k);
+    if (SPECULAR || sampled) {
+      r = r + float4::load(b.sr + k);
+      g = g + float4::load(b.sg + k);
+      bl = bl + float4::load(b.sb + k);
+    }
+    r.store(b.ar + k);
+    g.store(b.ag + k);
+    bl.store(b.ab + k);
+  }
+  // averaged with the previous frames
+  if (sampled) accumulate(b);
+}
+
+template <bool SHADOWS>
+void render::sample_lights(shade_batch& b) {
+  // ambiant of every light
+  glm::vec4 amb(0.0f);
+  for (int j = 0; j < lcount; ++j) amb += pl[j].ambiant();
+  for (int k = 0; k < b.n; ++k) {
+    b.ar[k] = b.ao[k] * amb.x;
+    b.ag[k] = b.ao[k] * amb.y;
+    b.ab[k] = b.ao[k] * amb.z;
+  }
+  const float eps = std::numeric_limits<float>::epsilon();
+  // should be in material (structure)
+  const float spec_start = 0.90f;
+  const float spec_scale = 10.0f;
+  float inv_n = 1.0f / (float)light_samples;
+  for (int k = 0; k < b.n; ++k) {
+    glm::vec3 p(b.px[k], b.py[k], b.pz[k]);
+    glm::vec3 n(b.nx[k], b.ny[k], b.nz[k]);
+    unsigned int seed = hash_uint((unsigned int)(b.x[k] + b.y[k] * dx)) +
+                        (unsigned int)(acc_frames * light_samples);
+    for (int s = 0; s < light_samples; ++s) {
+      float prob;
+      int j = plt->sample(p, n, hash_float(seed + s), &prob);
+      if (j < 0) continue;
+      glm::vec3 l = pl[j].position() - p;
+      float len2 = glm::dot(l, l);
+      l = l * (1.0f / sqrtf(len2));
+      float ndl = glm::dot(n, l);
+      // if the angle is too sharp or behind target
+      if (ndl < eps) continue;
+      float vis = pl[j].attenuation(len2);
+      if (vis == 0.0f) continue;
+      if (SHADOWS) {
+        b.lx[k] = l.x;
+        b.ly[k] = l.y;
+        b.lz[k] = l.z;
+        if (pl[j].technique() == shadow_map_cube) {
+          vis *= psm[j].visibility(p, b.id[k], ndl);
+        } else if (pl[j].technique() == shadow_sdf) {
+          vis *= pdf->cone_visibility(p, face_normal(b, k), pl[j].position(),
+                                      pl[j].radius());
+        } else if (!sample_lit(j, b, k)) {
+          vis = 0.0f;
+        }
+        if (vis == 0.0f) continue;
+      }
+      // contribution over the probability of the choice
+      float w = vis * inv_n / prob;
+      float vd = w * ndl;
+      float vs = w * std::max(ndl - spec_start, 0.0f) * spec_scale;
+      glm::vec4 diff = pl[j].diffuse();
+      glm::vec4 spec = pl[j].specular();
+      b.ar[k] += vd * diff.x;
+      b.ag[k] += vd * diff.y;
+      b.ab[k] += vd * diff.z;
+      b.sr[k] += vs * spec.x;
+      b.sg[k] += vs * spec.y;
+      b.sb[k] += vs * spec.z;
     }
   }
-  return clampRGBA(col);
 }
 
+void render::texture_batch(shade_batch& b) {
+  const float eps = std::numeric_limits<float>::epsilon();
+  int n4 = (b.n + 3) & ~3;
+  for (int k = 0; k < n4; ++k) {
+    // (no texture coordinates on the primitives)
+    if (is_primitive(b.id[k])) continue;
+    const tri_record& r = tri->get_record(b.id[k]);
+    glm::vec2 uv = tri->intersect_texmap(r.vi[0], r.vi[1], r.vi[2],
+                                         glm::vec4(b.t[k], b.u[k], b.v[k], 0));
+    // unnormalized direction of the pixel and its derivatives once
+    // normalized (one pixel right and one pixel down)
+    glm::vec3 dir = top_left + right_step * (float)b.x[k] -
+                    up_step * (float)b.y[k];
+    float dd = glm::dot(dir, dir);
+    float il = 1.0f / sqrtf(dd);
+    glm::vec3 d = dir * il;
+    float il3 = il * il * il;
+    glm::vec3 ddx = (right_step * dd - dir * glm::dot(dir, right_step)) * il3;
+    glm::vec3 ddy = (dir * glm::dot(dir, up_step) - up_step * dd) * il3;
+    // transfer to the plane of the triangle
+    float lod = 0.0f;
+    float dn = glm::dot(d, r.normal);
+    if (fabsf(dn) > eps) {
+      float t = b.t[k];
+      glm::vec3 dpdx = ddx * t - d * (t * glm::dot(ddx, r.normal) / dn);
+      glm::vec3 dpdy = ddy * t - d * (t * glm::dot(ddy, r.normal) / dn);
+      // barycentric gradients
+      float inv_nn = 1.0f / glm::dot(r.normal, r.normal);
+      glm::vec3 gu = glm::cross(r.edge2, r.normal) * inv_nn;
+      glm::vec3 gv = glm::cross(r.normal, r.edge1) * inv_nn;
+      glm::vec2 uv0 = glm::vec2(pvb->get_UV(r.vi[0]));
+      glm::vec2 e1 = glm::vec2(pvb->get_UV(r.vi[1])) - uv0;
+      glm::vec2 e2 = glm::vec2(pvb->get_UV(r.vi[2])) - uv0;
+      glm::vec2 duvdx = e1 * glm::dot(dpdx, gu) + e2 * glm::dot(dpdx, gv);
+      glm::vec2 duvdy = e1 * glm::dot(dpdy, gu) + e2 * glm::dot(dpdy, gv);
+      lod = ptexture->lod(duvdx, duvdy);
+    }
+    glm::vec3 c = trilinear ? ptexture->trilinear(uv, lod)
+                            : ptexture->sample(uv, lod);
+    b.cr[k] *= c.x;
+    b.cg[k] *= c.y;
+    b.cb[k] *= c.z;
+  }
+}
+
+void render::accumulate(shade_batch& b) {
+  float inv = 1.0f / (float)(acc_frames + 1);
+  for (int k = 0; k < b.n; ++k) {
+    glm::vec3& sum = (*pacc)(b.x[k], b.y[k]);
+    glm::vec3 c(b.ar[k], b.ag[k], b.ab[k]);
+    sum = acc_frames ? sum + c : c;
+    c = sum * inv;
+    b.ar[k] = c.x;
+    b.ag[k] = c.y;
+    b.ab[k] = c.z;
+  }
+}
+
+// indexed by shadows * 8 + multi light * 4 + vertex colour * 2 + specular
+const render::phong_fn render::phong_table[16] = {
+    &render::phong<false, false, false, false>,
+    &render::phong<false, false, false, true>,
+    &render::phong<false, false, true, false>,
+    &render::phong<false, false, true, true>,
+    &render::phong<false, true, false, false>,
+    &render::phong<false, true, false, true>,
+    &render::phong<false, true, true, false>,
+    &render::phong<false, true, true, true>,
+    &render::phong<true, false, false, false>,
+    &render::phong<true, false, false, true>,
+    &render::phong<true, false, true, false>,
+    &render::phong<true, false, true, true>,
+    &render::phong<true, true, false, false>,
+    &render::phong<true, true, false, true>,
+    &render::phong<true, true, true, false>,
+    &render::phong<true, true, true, true>};
+
 }  // namespace miniRT
\ No newline at end of file
@@ -9,6 +9,8 @@
 #define __MINIRT_RENDER_DEFINED__
 
 #include "miniRT_cam.h"
+#include "miniRT_light.h"
+#include "miniRT_primitive.h"
 
 namespace miniRT {
 
@@ -16,9 +18,39 @@ class window;
 class vertex_buffer;
 class index_buffer;
 class triangle;
-class light;
+class ray_buffer;
+struct packet_triangle;
+struct tile;
+struct shade_batch;
+class occluder_cache;
+class light_classifier;
+class shadow_map;
+class sdf;
+class light_bake;
+class light_tree;
+class texture;
 template <typename T> class screen_buffer;
 
+// mapping of the linear colours (times the exposure) to the display
+enum tonemap_operator {
+  tonemap_clamp = 0,    // clamped to [0, 1]
+  tonemap_reinhard = 1  // c / (1 + c), keeps the highlights
+};
+
+// stride of the first level of the progressive mode
+const int progressive_start = 8;
+// relative distance under which two hit points are on the same surface
+// (reprojection, reconstruction, upscale and coarse shadows)
+const float depth_tolerance = 0.05f;
+// smallest band of pixels given to a thread of the tonemap pass (a
+// thread costs about 16 us to start and join, the pass about 1.4 ns per
+// pixel)
+const int tonemap_band = 1 << 18;
+// coarsest stride of the foveated mode
+const int max_fovea_step = 8;
+// smallest render size of the dynamic resolution (over the window)
+const float min_scale = 0.25f;
+
 class render {
   window* pw;
   vertex_buffer* pvb;
@@ -26,28 +58,343 @@ class render {
   index_buffer* pib;
   bool init;
   bool lock;
+  // render size (the top left of the buffers) and size of the buffers
+  // and of the displayed image
   int dx, dy;
+  int odx, ody;
   int maxobj;
   bool *sldx, *sldy;
   glm::vec4* bound_tri;
   triangle* tri;
   light* pl;
   int lcount;
+  // analytic shapes, their id is maxobj + index (after the triangles)
+  primitive* pprim;
+  int nprim;
   screen_buffer<float>* pzsb;
+  // linear colour per pixel and its age in frames (reprojection, -1 if
+  // it has to be shaded), tonemapped to pisb
+  screen_buffer<glm::vec4>* phdr;
   screen_buffer<unsigned int>* pisb;
+  float exposure;
+  tonemap_operator tonemap_op;
+  ray_buffer* prb;
+  // visible triangle per pixel (current and previous frame)
+  screen_buffer<int>* pidsb;
+  screen_buffer<int>* ppidsb;
+  int history_tests;
+  int history_hits;
+  // barycentric coordinates of the visible triangle per pixel
+  screen_buffer<glm::vec2>* puvsb;
+  // packet values per triangle (for the current camera position)
+  packet_triangle* ppt;
+  // bounding boxes (min, max) per triangle and per chunk of triangles
+  glm::vec3* pbox;
+  glm::vec3* pchunk;
+  // shadow candidates per light (maxobj per light) for the current tile
+  int* pcand;
+  int* pncand;
+  // per light and per triangle shadow classification
+  light_classifier* plc;
+  bool light_classes;
+  // versions of the lights and the geometry (and the ones classified)
+  int light_version;
+  int scene_version;
+  int vb_version;
+  int class_light_version;
+  int class_scene_version;
+  // cube shadow map per light (for the shadow_map_cube lights)
+  shadow_map* psm;
+  int shadow_map_size;
+  // distance field of the scene (shadow_sdf lights and occlusion)
+  sdf* pdf;
+  float sdf_voxel;
+  bool ambient_occlusion;
+  // baked ambiant + diffuse and visibility (static scenes)
+  light_bake* pbk;
+  bool baked_lighting;
+  float bake_texel;
+  // stochastic light selection (light_samples per pixel, 0 is off)
+  light_tree* plt;
+  int light_samples;
+  int tree_light_version;
+  // running sum of the sampled frames since the view last changed
+  screen_buffer<glm::vec3>* pacc;
+  int acc_frames;
+  glm::vec3 acc_pos;
+  int acc_light_version;
+  int acc_scene_version;
+  // coarse to fine : stride of the pixels traced and shaded in the
+  // current frame (8, 4, 2 then 1), 0 once every pixel is done
+  bool progressive;
+  int prog_step;
+  // linear background (ambiant of every light)
+  glm::vec4 back;
+  // reprojection : the colour, distance and camera of the last frame,
+  // reused up to reuse_age frames where the triangle and the distance
+  // agree (0 is off)
+  screen_buffer<glm::vec4>* pphdr;
+  screen_buffer<float>* ppzsb;
+  int reuse_age;
+  bool history_colour;
+  bool reusing;
+  glm::vec3 prev_pos;
+  glm::vec3 prev_to;
+  glm::vec3 prev_top_left;
+  glm::vec3 prev_right_step;
+  glm::vec3 prev_up_step;
+  int reuse_tests;
+  int reuse_hits;
+  // checkerboard : only the pixels of one colour are traced and shaded,
+  // the colour alternates every frame and the others are rebuilt from
+  // the last frame or the neighbours
+  bool checkerboard;
+  bool checkering;
+  int checker_parity;
+  bool prev_checkering;
+  int prev_parity;
+  // foveation : stride of the traced pixels per tile, 1 around the gaze
+  // point (window pixels) and coarser in rings towards the edges
+  bool foveation;
+  bool foveating;
+  glm::vec2 gaze;
+  float fovea_inner;
+  float fovea_outer;
+  int* pfovea;
+  int fovea_tiles;
+  // dynamic resolution : the render size follows the time of the last
+  // frames (milliseconds, 0 is off) between min_scale and 1
+  float target_ms;
+  float frame_ms;
+  double frame_start;
+  float scale;
+  // texture of the vertex buffer (not owned)
+  texture* ptexture;
+  bool trilinear;
+  // lights reaching the current tile
+  int* ptl;
+  int ntl;
+  // last occluders per light for the current tile
+  occluder_cache* pocc;
+  int occluder_tests;
+  int occluder_hits;
+  // samples of the tile being shaded
+  shade_batch* psb;
+  // one shadow sample every shadow_rate pixels (1, 2 or 4)
+  int shadow_rate;
+  bool shadows;
+  // one shaded sample every shading_rate pixels in uniform regions
+  int shading_rate;
+  // the three vertices of every triangle have the same colour
+  bool flat_colour;
+  // shading variant for the current frame (see phong_table)
+  typedef void (render::*phong_fn)(shade_batch& b);
+  phong_fn pphong;
+  static const phong_fn phong_table[16];
   glm::vec3 top_left;
   glm::vec3 right_step;
   glm::vec3 up_step;
-  unsigned int phong(glm::vec4 tuvi, glm::vec3 dir, int i);
-  unsigned int clampRGBA(glm::vec4 v);
+  void build_bounds();
+  void get_triangle(int i, glm::vec3* p0, glm::vec3* p1, glm::vec3* p2);
+  bool hit(int i, glm::vec3 pos, glm::vec3 dir, glm::vec4* tuvi);
+  void draw_history(int first, int last);
+  void draw_tile(const tile& t, int first, int last);
+  void draw_packet(int i, const packet_triangle& pt, int x, int y);
+  void draw_checker_packet(int i, const packet_triangle& pt, int x, int y);
+  void draw_ray(int i, int x, int y);
+  void draw_primitive_tile(const tile& t);
+  // start the accumulation and the refinement again
+  void restart() {
+    acc_frames = 0;
+    prog_step = progressive ? progressive_start : 0;
+    history_colour = false;
+  }
+  // traced and shaded in the current frame
+  bool level_pixel(int x, int y) const {
+    if (!prog_step) return true;
+    int m = prog_step - 1;
+    if ((x & m) || (y & m)) return false;
+    // the coarser levels are already done
+    int m2 = prog_step * 2 - 1;
+    return (prog_step == progressive_start) || (x & m2) || (y & m2);
+  }
+  // traced and shaded in the current checkerboard frame
+  bool checker_pixel(int x, int y) const {
+    return !checkering || !((x + y + checker_parity) & 1);
+  }
+  // stride of the tile in the foveated mode (1 otherwise)
+  int tile_step(const tile& t) const;
+  // on the lattice of its tile in the foveated mode
+  bool fovea_pixel(int x, int y) const;
+  void build_fovea();
+  void fill_periphery();
+  // position of p in the image of the last frame (pixel units), false
+  // if behind its camera
+  bool prev_pixel(glm::vec3 p, float* fx, float* fy) const;
+  bool prev_traced_pixel(float fx, float fy, int* px, int* py) const;
+  void reconstruct_checker();
+  void fill_progressive();
+  void reproject();
+  bool is_primitive(int id) const { return id >= maxobj; }
+  void shade();
+  void tonemap();
+  void tonemap_rows(int y0, int y1);
+  void tonemap_span(const glm::vec4* src, unsigned int* dst, int n);
+  glm::vec4 upscale(int x, int y) const;
+  void govern();
+  void shade_tile(const tile& t);
+  int push_sample(shade_batch& b, int x, int y);
+  void shade_samples(shade_batch& b);
+  bool uniform_cell(int x0, int y0, int x1, int y1);
+  void build_tile_lights(glm::vec3 bmin, glm::vec3 bmax);
+  void build_shadow_candidates(glm::vec3 bmin, glm::vec3 bmax);
+  bool shadowed(int j, int i, glm::vec3 hitpoint, glm::vec3 l);
+  bool primitive_shadowed(int j, int i, glm::vec3 hitpoint, glm::vec3 l);
+  bool sample_lit(int j, const shade_batch& b, int k);
+  void coarse_shadows(int j, shade_batch& b);
+  template <bool SHADOWS>
+  void sample_lights(shade_batch& b);
+  void accumulate(shade_batch& b);
+  void texture_batch(shade_batch& b);
+  glm::vec3 face_normal(const shade_batch& b, int k);
+  // specialised for shadows on / off, one or more lights, interpolated
+  // or per triangle colour and specular on / off
+  template <bool SHADOWS, bool MULTI_LIGHT, bool VERTEX_COLOUR, bool SPECULAR>
+  void phong(shade_batch& b);
 
  public:
   // create the scan line structure
   render(window* w, int x, int y, int obj);
   // some cleaning
   ~render();
-  // add a light to the rendering scene
+  // add a light to the rendering scene, only the lights whose range
+  // reach a tile are evaluated on it, see light::set_range (the ambiant
+  // of every light is always added)
   int add_light(const light& l);
+  // change the light i
+  void set_light(int i, const light& l);
+  // add an analytic shape (returns its index), shaded like the
+  // triangles but only casting shadows through the shadow rays (not in
+  // the shadow maps, the distance field or the baked lighting, where
+  // they only get the ambiant)
+  int add_primitive(const primitive& p);
+  // change the primitive i
+  void set_primitive(int i, const primitive& p);
+  // remove every primitive
+  void clear_primitives();
+  // classify the triangles per light (only redone when a light or the
+  // geometry change) to skip the shadow rays that cannot change the
+  // result, for static scenes (default on)
+  void set_light_classes(bool b) { light_classes = b; }
+  // change the way the shadows of the light i are computed (rays or
+  // cube shadow map), see light.h
+  void set_shadow_technique(int i, shadow_technique t);
+  // texels per side of the cube shadow map faces (default 256)
+  void set_shadow_map_size(int s);
+  // voxel size of the distance field (default 0.05)
+  void set_sdf_voxel_size(float v);
+  // darken the ambiant term with the occlusion from the distance field
+  // (default off)
+  void set_ambient_occlusion(bool b) {
+    ambient_occlusion = b;
+    restart();
+  }
+  // shade from the baked lighting (only the specular is computed per
+  // pixel), rebaked when a light or the geometry change (default off)
+  void set_baked_lighting(bool b) {
+    baked_lighting = b;
+    restart();
+  }
+  // distance between the baked samples (default 0.1)
+  void set_bake_texel_size(float t);
+  // trace the shadows at full (1), half (2) or quarter (4) resolution,
+  // the other pixels take the value of the coarse samples around them
+  // (same triangle or close depth) when they agree and are traced
+  // otherwise (default 1)
+  void set_shadow_rate(int r);
+  // shade once per 2x2 (2) or 4x4 (4) pixels where they all see the
+  // same triangle with a close normal and interpolate the colours in
+  // between, the cells whose corners do not agree (shadow edges,
+  // highlights) are shaded at full rate, ignored with the light
+  // samples (default 1)
+  void set_shading_rate(int r);
+  // compute the shadows (default on, off if built with WITHOUT_SHADOW)
+  void set_shadows(bool b) {
+    shadows = b;
+    restart();
+  }
+  // shadow ray budget per pixel : instead of every light, n lights are
+  // picked per pixel from a light tree (weighted by power and distance)
+  // and the frames are averaged as long as the view, the lights and the
+  // geometry stay the same, so the cost does not grow with the number
+  // of lights. the ambiant of every light is still added and the
+  // shadow rate is ignored (0 evaluates every light, default 0)
+  void set_light_samples(int n);
+  // scale of the linear colours before the tonemap (default 1)
+  void set_exposure(float e) { exposure = e; }
+  float get_exposure() const { return exposure; }
+  // (default tonemap_clamp)
+  void set_tonemap(tonemap_operator t) { tonemap_op = t; }
+  // progressive mode : after a change of the view or of the scene,
+  // the frames only trace and shade every 8th pixel, then every 4th,
+  // 2nd and the rest, the pixels not done yet take the colour of the
+  // closest one that is, every present shows the current level and a
+  // change restarts at the first one (the shading rate is ignored
+  // until the last level, default off)
+  void set_progressive(bool b) {
+    progressive = b;
+    restart();
+  }
+  // reuse the colour of the last frame where the hit point seen
+  // through the last camera is on the same triangle at the same
+  // distance, for up to max_age frames (spread over the pixels),
+  // only the other pixels are shaded, ignored with the light samples,
+  // during the progressive levels and the shading rate is ignored
+  // (0 is off, default 0)
+  void set_reprojection(int max_age);
+  // trace and shade half the pixels (a checkerboard, the other half in
+  // the next frame), a missing pixel takes the colour of the last frame
+  // where the surface of one of its 4 neighbours projects onto a pixel
+  // traced then with the same triangle at the same distance, and the
+  // average of the neighbours on the same surface otherwise, ignored
+  // with the light samples, during the progressive levels and in the
+  // foveated mode, the shading rate is ignored (default off)
+  void set_checkerboard(bool b) {
+    checkerboard = b;
+    restart();
+  }
+  // trace every pixel of the tiles near the gaze point only, the
+  // others trace one pixel per 2x2, 4x4 or 8x8 block and the rest take
+  // the colour of the closest one, ignored with the light samples and
+  // during the progressive levels (default off)
+  void set_foveation(bool b) {
+    foveation = b;
+    restart();
+  }
+  // gaze point in window pixels from the top left (mouse, eye tracker),
+  // can change every frame (default the centre)
+  void set_gaze(float x, float y) { gaze = glm::vec2(x, y); }
+  // every pixel within inner window pixels of the gaze point, 2x2 blocks
+  // up to outer, then 4x4 and 8x8 blocks in rings of the same width
+  // (default a quarter and a half of the window height)
+  void set_fovea_radii(float inner, float outer);
+  // change the render size (the same aspect as the window) each frame
+  // so that the time from clear_buffer to present stays close to ms,
+  // the image is upscaled at present (the bilinear weights of the
+  // samples on another triangle at another distance are dropped so
+  // the edges stay sharp), a change of size restarts the history, the
+  // accumulation and the progressive levels (0 is off, default 0)
+  void set_target_frame_time(float ms);
+  // render size over the window size (1 if off)
+  float resolution_scale() const { return (float)dy / (float)ody; }
+  int render_width() const { return dx; }
+  int render_height() const { return dy; }
+  // time of the last frames (milliseconds, averaged)
+  float frame_time() const { return frame_ms; }
+  // stride of the next level (0 if the image is complete)
+  int refinement_step() const { return prog_step; }
+  // frames averaged in the current image (light samples only)
+  int accumulated_frames() const { return acc_frames; }
   // precalc all (prepare structures for drawing and lock)
   bool begin();
   // (unlock)
@@ -63,13 +410,34 @@ class render {
   // set the index buffer for the future drawing
   // (before begin)
   void set_index_buffer(index_buffer* ib);
-  // draw the triangles between first and last
+  // modulate the vertex colour by the texture t at the vertex uv (0
+  // for none), the level is chosen per pixel from the ray differentials
+  // (before begin)
+  void set_texture(texture* t);
+  // blend the 2 closest levels or only use the nearest one (default on)
+  void set_trilinear(bool b) {
+    trilinear = b;
+    restart();
+  }
+  // draw the triangles between first and last, only find the visible
+  // triangle per pixel, shading is done at present
   // (between begin and end)
   bool draw_indexed_triangles(int first, int last);
+  // find the visible primitive per pixel (one intersection per pixel,
+  // against the Z of the triangles already drawn)
+  // (between begin and end)
+  bool draw_primitives();
   // clear the Z buffer
   void clear_buffer();
-  // finalize the rendering
+  // shade the visible pixels and finalize the rendering
   void present();
+  // part of the pixels that hit the same triangle as in the previous
+  // frame (over the pixels that had one in the drawn range)
+  float history_hit_rate() const;
+  // part of the shadow queries answered by the per tile occluder cache
+  float occluder_hit_rate() const;
+  // part of the visible pixels whose colour was reprojected
+  float reuse_rate() const;
 };
 
 }  // end namespace miniRT
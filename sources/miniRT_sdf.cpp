@@ -0,0 +1,291 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT sdf
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_sdf.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "miniRT_new.h"
+#include "miniRT_triangle.h"
+
+namespace miniRT {
+
+namespace {
+// fixed cost of the queries
+const int cone_steps = 48;
+const int occlusion_steps = 5;
+// samples are kept up to that many voxels around the surfaces (the
+// reach of the occlusion)
+const float dense_band = 2.0f * (float)occlusion_steps;
+
+// closest point to p on the triangle (a, a + ab, a + ac)
+glm::vec3 closest_point(glm::vec3 p, glm::vec3 a, glm::vec3 ab,
+                        glm::vec3 ac) {
+  glm::vec3 ap = p - a;
+  float d1 = glm::dot(ab, ap);
+  float d2 = glm::dot(ac, ap);
+  if ((d1 <= 0.0f) && (d2 <= 0.0f)) return a;
+  glm::vec3 bp = ap - ab;
+  float d3 = glm::dot(ab, bp);
+  float d4 = glm::dot(ac, bp);
+  if ((d3 >= 0.0f) && (d4 <= d3)) return a + ab;
+  float vc = d1 * d4 - d3 * d2;
+  if ((vc <= 0.0f) && (d1 >= 0.0f) && (d3 <= 0.0f))
+    return a + ab * (d1 / (d1 - d3));
+  glm::vec3 cp = ap - ac;
+  float d5 = glm::dot(ab, cp);
+  float d6 = glm::dot(ac, cp);
+  if ((d6 >= 0.0f) && (d5 <= d6)) return a + ac;
+  float vb = d5 * d2 - d1 * d6;
+  if ((vb <= 0.0f) && (d2 >= 0.0f) && (d6 <= 0.0f))
+    return a + ac * (d2 / (d2 - d6));
+  float va = d3 * d6 - d5 * d4;
+  if ((va <= 0.0f) && ((d4 - d3) >= 0.0f) && ((d5 - d6) >= 0.0f))
+    return a + ab + (ac - ab) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+  float denom = 1.0f / (va + vb + vc);
+  return a + ab * (vb * denom) + ac * (vc * denom);
+}
+
+// distance to the triangle record
+float triangle_distance(glm::vec3 p, const tri_record& r) {
+  return glm::length(p - closest_point(p, r.v0, r.edge1, r.edge2));
+}
+
+// distance from the point to the box
+float box_distance(glm::vec3 p, glm::vec3 bmin, glm::vec3 bmax) {
+  glm::vec3 d = glm::max(glm::max(bmin - p, p - bmax), glm::vec3(0.0f));
+  return glm::length(d);
+}
+}  // namespace
+
+sdf::sdf()
+    : voxel(0.0f),
+      version(-1),
+      valid(false),
+      nx(0),
+      ny(0),
+      nz(0),
+      pbrick(0),
+      pcenter(0),
+      ppool(0),
+      nbrick(0) {}
+
+sdf::~sdf() {
+  if (pbrick) delete[] pbrick;
+  if (pcenter) delete[] pcenter;
+  if (ppool) delete[] ppool;
+}
+
+bool sdf::update(const triangle* tri, float v, int ver) {
+  assert(tri);
+  assert(v > 0.0f);
+  if (valid && (v == voxel) && (ver == version)) return false;
+  voxel = v;
+  version = ver;
+  build(tri);
+  valid = true;
+  return true;
+}
+
+void sdf::build(const triangle* tri) {
+  if (pbrick) delete[] pbrick;
+  if (pcenter) delete[] pcenter;
+  if (ppool) delete[] ppool;
+  pbrick = 0;
+  pcenter = 0;
+  ppool = 0;
+  nbrick = 0;
+  if (!tri->size()) return;
+  // scene box padded by a brick
+  bmin = glm::vec3(std::numeric_limits<float>::max());
+  bmax = glm::vec3(-std::numeric_limits<float>::max());
+  for (int i = 0; i < tri->size(); ++i) {
+    const tri_record& r = tri->get_record(i);
+    glm::vec3 p[3] = {r.v0, r.v0 + r.edge1, r.v0 + r.edge2};
+    for (int c = 0; c < 3; ++c) {
+      bmin = glm::min(bmin, p[c]);
+      bmax = glm::max(bmax, p[c]);
+    }
+  }
+  float extent = voxel * (float)brick_size;
+  bmin -= glm::vec3(extent);
+  bmax += glm::vec3(extent);
+  glm::vec3 size = (bmax - bmin) / extent;
+  nx = (int)ceilf(size.x);
+  ny = (int)ceilf(size.y);
+  nz = (int)ceilf(size.z);
+  bmax = bmin + glm::vec3((float)nx, (float)ny, (float)nz) * extent;
+  nbrick = nx * ny * nz;
+  pbrick = new int[nbrick];
+  pcenter = new float[nbrick];
+  assert(pbrick);
+  assert(pcenter);
+  int nthread = std::max(1, (int)std::thread::hardware_concurrency());
+  // distance at the brick centers (which bricks are near a surface)
+  // then the samples of these bricks
+  for (int pass = 0; pass < 2; ++pass) {
+    std::atomic<int> next(0);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < nthread; ++t)
+      workers.push_back(
+          std::thread(&sdf::build_bricks, this, tri, pass, &next));
+    for (int t = 0; t < nthread; ++t) workers[t].join();
+    if (pass) break;
+    int npool = 0;
+    for (int b = 0; b < nbrick; ++b) {
+      if (pbrick[b] < 0) continue;
+      pbrick[b] = npool;
+      npool += brick_samples * brick_samples * brick_samples;
+    }
+    if (npool) {
+      ppool = new float[npool];
+      assert(ppool);
+    }
+  }
+}
+
+void sdf::build_bricks(const triangle* tri, int pass,
+                       std::atomic<int>* next) {
+  float extent = voxel * (float)brick_size;
+  float half_diag = 0.5f * extent * sqrtf(3.0f);
+  std::vector<int> cand;
+  for (int b = (*next)++; b < nbrick; b = (*next)++) {
+    int bx = b % nx;
+    int by = (b / nx) % ny;
+    int bz = b / (nx * ny);
+    glm::vec3 o = bmin + glm::vec3((float)bx, (float)by, (float)bz) * extent;
+    glm::vec3 center = o + glm::vec3(0.5f * extent);
+    if (!pass) {
+      float dc = std::numeric_limits<float>::max();
+      for (int i = 0; i < tri->size(); ++i)
+        dc = std::min(dc, triangle_distance(center, tri->get_record(i)));
+      // samples only near the surfaces
+      pbrick[b] = (dc - half_diag < dense_band * voxel) ? 0 : -1;
+      pcenter[b] = dc;
+      continue;
+    }
+    float dc = pcenter[b];
+    if (pbrick[b] < 0) continue;
+    // only the triangles that can be the closest to a sample
+    cand.clear();
+    glm::vec3 omax = o + glm::vec3(extent);
+    for (int i = 0; i < tri->size(); ++i) {
+      const tri_record& r = tri->get_record(i);
+      glm::vec3 p1 = r.v0 + r.edge1;
+      glm::vec3 p2 = r.v0 + r.edge2;
+      glm::vec3 tmin = glm::min(r.v0, glm::min(p1, p2));
+      glm::vec3 tmax = glm::max(r.v0, glm::max(p1, p2));
+      glm::vec3 gap =
+          glm::max(glm::max(tmin - omax, o - tmax), glm::vec3(0.0f));
+      if (glm::length(gap) <= dc + half_diag) cand.push_back(i);
+    }
+    float* ps = ppool + pbrick[b];
+    for (int z = 0; z < brick_samples; ++z)
+      for (int y = 0; y < brick_samples; ++y)
+        for (int x = 0; x < brick_samples; ++x) {
+          glm::vec3 p = o + glm::vec3((float)x, (float)y, (float)z) * voxel;
+          float best = std::numeric_limits<float>::max();
+          for (size_t c = 0; c < cand.size(); ++c) {
+            best = std::min(best,
+                            triangle_distance(p, tri->get_record(cand[c])));
+          }
+          *ps++ = best;
+        }
+  }
+}
+
+float sdf::brick_distance(int b, glm::vec3 p) const {
+  const float* ps = ppool + pbrick[b];
+  glm::vec3 f = glm::min(glm::max(p / voxel, glm::vec3(0.0f)),
+                         glm::vec3((float)brick_size - 0.001f));
+  int x = (int)f.x;
+  int y = (int)f.y;
+  int z = (int)f.z;
+  f -= glm::vec3((float)x, (float)y, (float)z);
+  const int sy = brick_samples;
+  const int sz = brick_samples * brick_samples;
+  const float* c = ps + x + y * sy + z * sz;
+  float c00 = c[0] + (c[1] - c[0]) * f.x;
+  float c10 = c[sy] + (c[sy + 1] - c[sy]) * f.x;
+  float c01 = c[sz] + (c[sz + 1] - c[sz]) * f.x;
+  float c11 = c[sz + sy] + (c[sz + sy + 1] - c[sz + sy]) * f.x;
+  float c0 = c00 + (c10 - c00) * f.y;
+  float c1 = c01 + (c11 - c01) * f.y;
+  return c0 + (c1 - c0) * f.z;
+}
+
+float sdf::distance(glm::vec3 p) const {
+  assert(valid);
+  if (!nbrick) return std::numeric_limits<float>::max();
+  float extent = voxel * (float)brick_size;
+  glm::vec3 f = (p - bmin) / extent;
+  int x = (int)floorf(f.x);
+  int y = (int)floorf(f.y);
+  int z = (int)floorf(f.z);
+  // nothing outside the box
+  if ((x < 0) || (y < 0) || (z < 0) || (x >= nx) || (y >= ny) || (z >= nz))
+    return box_distance(p, bmin, bmax) + extent;
+  int b = x + y * nx + z * nx * ny;
+  glm::vec3 o = bmin + glm::vec3((float)x, (float)y, (float)z) * extent;
+  if (pbrick[b] < 0)
+    return std::max(
+        0.0f, pcenter[b] - glm::length(p - o - glm::vec3(0.5f * extent)));
+  return brick_distance(b, p - o);
+}
+
+float sdf::cone_visibility(glm::vec3 p, glm::vec3 n, glm::vec3 l,
+                           float r) const {
+  glm::vec3 d = l - p;
+  float len = glm::length(d);
+  d = d / len;
+  // tangent of the cone half angle (never a zero width cone)
+  float k = std::max(r / len, 0.01f);
+  // leave the surface of the receiver
+  glm::vec3 o = p + n * (2.0f * voxel);
+  float t = voxel;
+  float maxt = len - r;
+  // nothing to hit once out of the box
+  for (int a = 0; a < 3; ++a) {
+    if (d[a] == 0.0f) continue;
+    float e = ((d[a] > 0.0f ? bmax[a] : bmin[a]) - o[a]) / d[a];
+    maxt = std::min(maxt, e);
+  }
+  float vis = 1.0f;
+  for (int s = 0; (s < cone_steps) && (t < maxt); ++s) {
+    // the trilinear distance does not reach 0 on a surface between
+    // samples, under a voxel is a hit
+    float h = distance(o + d * t) - voxel;
+    if (h <= 0.0f) return 0.0f;
+    // part of the cone section that is free
+    vis = std::min(vis, h / (k * t));
+    t += h + voxel;
+  }
+  return std::min(vis, 1.0f);
+}
+
+float sdf::occlusion(glm::vec3 p, glm::vec3 n) const {
+  float occ = 0.0f;
+  float total = 0.0f;
+  float w = 1.0f;
+  for (int s = 1; s <= occlusion_steps; ++s) {
+    // steps of 2 voxels along the normal, the far ones count less
+    float h = 2.0f * voxel * (float)s;
+    occ += w * std::max(0.0f, h - distance(p + n * h)) / h;
+    total += w;
+    w *= 0.5f;
+  }
+  return std::max(0.0f, 1.0f - occ / total);
+}
+
+}  // end namespace miniRT
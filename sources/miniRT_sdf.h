@@ -0,0 +1,68 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT sdf (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// sparse distance field of the scene triangles. the box around
+// the scene is cut in bricks of brick_size^3 voxels, only the bricks
+// near a surface keep their samples (on the voxel corners, trilinear
+// lookup), the others only the distance from their center. the field
+// answers sphere traced cone queries (soft shadows of a light with a
+// radius) and ambient occlusion at a fixed cost per sample. the
+// distance is unsigned : the meshes are open and their winding does
+// not always follow the vertex normals.
+
+#ifndef __MINIRT_SDF_DEFINED__
+#define __MINIRT_SDF_DEFINED__
+
+#include <atomic>
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class triangle;
+
+class sdf {
+  static const int brick_size = 8;
+  static const int brick_samples = brick_size + 1;
+  float voxel;
+  int version;
+  bool valid;
+  // scene box (padded) and bricks per axis
+  glm::vec3 bmin;
+  glm::vec3 bmax;
+  int nx, ny, nz;
+  // per brick : offset of its samples in ppool (-1 far from the
+  // surfaces) and distance from its center (lower bound of the
+  // distance inside the brick minus the distance to the center)
+  int* pbrick;
+  float* pcenter;
+  float* ppool;
+  int nbrick;
+  void build(const triangle* tri);
+  void build_bricks(const triangle* tri, int pass, std::atomic<int>* next);
+  float brick_distance(int b, glm::vec3 p) const;
+
+ public:
+  sdf();
+  ~sdf();
+  // rebuild the field for the geometry version (render scene version)
+  // with voxels of size v if any of them changed, multithreaded,
+  // return true if the field was regenerated
+  bool update(const triangle* tri, float v, int ver);
+  float get_voxel() const { return voxel; }
+  // distance at p to the closest triangle, a lower bound far from the
+  // surfaces
+  float distance(glm::vec3 p) const;
+  // soft visibility in [0, 1] of the sphere of radius r at l from p
+  // (normal n) by tracing the cone toward it
+  float cone_visibility(glm::vec3 p, glm::vec3 n, glm::vec3 l,
+                        float r) const;
+  // ambient occlusion in [0, 1] (1 is open) at p along the normal n
+  float occlusion(glm::vec3 p, glm::vec3 n) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_SDF_DEFINED__
@@ -0,0 +1,78 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT shade (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// visible samples shaded together (one tile at a time). everything is
+// stored as SoA so the shading runs on 4 samples at a time.
+
+#ifndef __MINIRT_SHADE_DEFINED__
+#define __MINIRT_SHADE_DEFINED__
+
+#include "miniRT_tile.h"
+
+namespace miniRT {
+
+// maximum number of samples in a batch (plus padding)
+const int max_batch = tile_size * tile_size + 4;
+// maximum number of coarse shadow samples of a tile (rate 2)
+const int max_coarse = (tile_size / 2 + 1) * (tile_size / 2 + 1);
+
+struct shade_batch {
+  // number of samples, the arrays are padded to a multiple of 4
+  int n;
+  // tile and sample per pixel of the tile (-1 if none)
+  int x0, y0, x1, y1;
+  int slot[tile_size * tile_size];
+  // uniform cell interpolating each pixel of the tile (-1 if shaded)
+  int cell[tile_size * tile_size];
+  // coarse shadow samples of the current light (1 lit, 0 shadowed and
+  // -1 unknown)
+  int coarse[max_coarse];
+  // pixel and visible triangle
+  int x[max_batch];
+  int y[max_batch];
+  int id[max_batch];
+  // distance and barycentric coordinates
+  float t[max_batch];
+  float u[max_batch];
+  float v[max_batch];
+  // ray direction
+  float dx[max_batch];
+  float dy[max_batch];
+  float dz[max_batch];
+  // vertex normals and colours [corner][component]
+  float vn[3][3][max_batch];
+  float vc[3][3][max_batch];
+  // interpolated normal, colour and hit point
+  float nx[max_batch];
+  float ny[max_batch];
+  float nz[max_batch];
+  float cr[max_batch];
+  float cg[max_batch];
+  float cb[max_batch];
+  float px[max_batch];
+  float py[max_batch];
+  float pz[max_batch];
+  // ambient occlusion (1 if disabled)
+  float ao[max_batch];
+  // current light : incoming light normal, N.L and visibility (0 or 1)
+  float lx[max_batch];
+  float ly[max_batch];
+  float lz[max_batch];
+  float ndl[max_batch];
+  float vis[max_batch];
+  // accumulated (ambiant + diffuse) and specular, the linear result is
+  // left in ar, ag and ab
+  float ar[max_batch];
+  float ag[max_batch];
+  float ab[max_batch];
+  float sr[max_batch];
+  float sg[max_batch];
+  float sb[max_batch];
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_SHADE_DEFINED__
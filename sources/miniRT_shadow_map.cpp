@@ -0,0 +1,176 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT shadow map
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_shadow_map.h"
+
+#include <assert.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <glm/glm.hpp>
+
+#include "miniRT_new.h"
+#include "miniRT_triangle.h"
+
+namespace miniRT {
+
+namespace {
+// face axes (forward, s and t) for +x, -x, +y, -y, +z and -z
+const glm::vec3 face_axis[6][3] = {
+    {glm::vec3(1, 0, 0), glm::vec3(0, 0, -1), glm::vec3(0, -1, 0)},
+    {glm::vec3(-1, 0, 0), glm::vec3(0, 0, 1), glm::vec3(0, -1, 0)},
+    {glm::vec3(0, 1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, 1)},
+    {glm::vec3(0, -1, 0), glm::vec3(1, 0, 0), glm::vec3(0, 0, -1)},
+    {glm::vec3(0, 0, 1), glm::vec3(1, 0, 0), glm::vec3(0, -1, 0)},
+    {glm::vec3(0, 0, -1), glm::vec3(-1, 0, 0), glm::vec3(0, -1, 0)}};
+// vertices closer than that to the light plane of a face are not
+// projected (the whole face is scanned instead)
+const float near_plane = 1e-4f;
+
+// face of the direction d and its coordinates in [-1, 1]
+int face_of(glm::vec3 d, float* s, float* t) {
+  glm::vec3 a = glm::abs(d);
+  int f;
+  if ((a.x >= a.y) && (a.x >= a.z))
+    f = (d.x > 0.0f) ? 0 : 1;
+  else if (a.y >= a.z)
+    f = (d.y > 0.0f) ? 2 : 3;
+  else
+    f = (d.z > 0.0f) ? 4 : 5;
+  float inv = 1.0f / glm::dot(d, face_axis[f][0]);
+  *s = glm::dot(d, face_axis[f][1]) * inv;
+  *t = glm::dot(d, face_axis[f][2]) * inv;
+  return f;
+}
+}  // namespace
+
+shadow_map::shadow_map()
+    : res(0), pdist(0), pid(0), valid(false), version(-1) {}
+
+shadow_map::~shadow_map() {
+  if (pdist) delete[] pdist;
+  if (pid) delete[] pid;
+}
+
+bool shadow_map::update(const triangle* tri, glm::vec3 l, int v, int r) {
+  assert(tri);
+  assert(r > 0);
+  if (valid && (l == lpos) && (v == version) && (r == res)) return false;
+  if (r != res) {
+    if (pdist) delete[] pdist;
+    if (pid) delete[] pid;
+    res = r;
+    pdist = new float[6 * res * res];
+    pid = new int[6 * res * res];
+    assert(pdist);
+    assert(pid);
+  }
+  lpos = l;
+  version = v;
+  std::fill(pdist, pdist + 6 * res * res, std::numeric_limits<float>::max());
+  std::fill(pid, pid + 6 * res * res, -1);
+  for (int face = 0; face < 6; ++face)
+    for (int i = 0; i < tri->size(); ++i) raster(face, tri, i);
+  valid = true;
+  return true;
+}
+
+void shadow_map::raster(int face, const triangle* tri, int i) {
+  const tri_record& r = tri->get_record(i);
+  glm::vec3 p[3] = {r.v0 - lpos, r.v0 + r.edge1 - lpos, r.v0 + r.edge2 - lpos};
+  const glm::vec3* axis = face_axis[face];
+  // texel bounds of the projected triangle
+  float smin = 1.0f, smax = -1.0f, tmin = 1.0f, tmax = -1.0f;
+  int behind = 0;
+  bool near = false;
+  for (int c = 0; c < 3; ++c) {
+    float a = glm::dot(p[c], axis[0]);
+    if (a <= 0.0f) ++behind;
+    if (a <= near_plane) {
+      near = true;
+      continue;
+    }
+    float s = glm::dot(p[c], axis[1]) / a;
+    float t = glm::dot(p[c], axis[2]) / a;
+    smin = std::min(smin, s);
+    smax = std::max(smax, s);
+    tmin = std::min(tmin, t);
+    tmax = std::max(tmax, t);
+  }
+  if (behind == 3) return;
+  if (near) {
+    // crosses the plane of the light, scan the whole face
+    smin = tmin = -1.0f;
+    smax = tmax = 1.0f;
+  }
+  float half = 0.5f * (float)res;
+  int s0 = std::max(0, (int)floorf((smin + 1.0f) * half - 0.5f));
+  int s1 = std::min(res - 1, (int)ceilf((smax + 1.0f) * half - 0.5f));
+  int t0 = std::max(0, (int)floorf((tmin + 1.0f) * half - 0.5f));
+  int t1 = std::min(res - 1, (int)ceilf((tmax + 1.0f) * half - 0.5f));
+  if ((s0 > s1) || (t0 > t1)) return;
+  // ray from the light through each texel center (Moller-Trumbore)
+  float* pf = pdist + face * res * res;
+  int* pi = pid + face * res * res;
+  glm::vec3 tvec = -p[0];
+  glm::vec3 qvec = glm::cross(tvec, r.edge1);
+  float tnum = glm::dot(r.edge2, qvec);
+  for (int t = t0; t <= t1; ++t) {
+    float ft = ((float)t + 0.5f) / half - 1.0f;
+    for (int s = s0; s <= s1; ++s) {
+      float fs = ((float)s + 0.5f) / half - 1.0f;
+      glm::vec3 d = axis[0] + axis[1] * fs + axis[2] * ft;
+      glm::vec3 pvec = glm::cross(d, r.edge2);
+      float det = glm::dot(r.edge1, pvec);
+      if (fabs(det) < std::numeric_limits<float>::epsilon()) continue;
+      float inv_det = 1.0f / det;
+      float u = glm::dot(tvec, pvec) * inv_det;
+      if ((u < 0.0f) || (u > 1.0f)) continue;
+      float v = glm::dot(d, qvec) * inv_det;
+      if ((v < 0.0f) || (u + v > 1.0f)) continue;
+      float dist = tnum * inv_det;
+      if (dist <= 0.0f) continue;
+      dist *= glm::length(d);
+      if (dist < pf[t * res + s]) {
+        pf[t * res + s] = dist;
+        pi[t * res + s] = i;
+      }
+    }
+  }
+}
+
+float shadow_map::visibility(glm::vec3 p, int i, float ndl) const {
+  assert(valid);
+  glm::vec3 d = p - lpos;
+  float dist = glm::length(d);
+  float fs, ft;
+  int face = face_of(d, &fs, &ft);
+  // a texel footprint at that distance, more on grazing surfaces (for
+  // the neighbour triangles)
+  float slope =
+      sqrtf(std::max(0.0f, 1.0f - ndl * ndl)) / std::max(ndl, 0.125f);
+  float bias = dist * (2.0f / (float)res) * (1.0f + slope);
+  float half = 0.5f * (float)res;
+  int s = (int)((fs + 1.0f) * half);
+  int t = (int)((ft + 1.0f) * half);
+  const float* pf = pdist + face * res * res;
+  int lit = 0;
+  int count = 0;
+  for (int y = t - 1; y <= t + 1; ++y) {
+    if ((y < 0) || (y >= res)) continue;
+    for (int x = s - 1; x <= s + 1; ++x) {
+      if ((x < 0) || (x >= res)) continue;
+      ++count;
+      int o = y * res + x;
+      if ((pid[face * res * res + o] == i) || (dist - bias <= pf[o])) ++lit;
+    }
+  }
+  return (float)lit / (float)count;
+}
+
+}  // end namespace miniRT
@@ -0,0 +1,50 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT shadow map (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// cube depth map around a point light, rasterized on the CPU from the
+// triangle records. each texel keeps the distance from the light to
+// the closest triangle in its direction and its id, the lookup filters
+// 3x3 texels (PCF) and gives a soft visibility in [0, 1]. a texel of
+// the receiving triangle itself never shadows it (no acne without a
+// large bias).
+
+#ifndef __MINIRT_SHADOW_MAP_DEFINED__
+#define __MINIRT_SHADOW_MAP_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+class triangle;
+
+class shadow_map {
+  int res;
+  // distance per [face * res * res + t * res + s]
+  float* pdist;
+  int* pid;
+  // what the map was built for
+  bool valid;
+  glm::vec3 lpos;
+  int version;
+  void raster(int face, const triangle* tri, int i);
+
+ public:
+  shadow_map();
+  ~shadow_map();
+  // rebuild the map of a light at l for the geometry version (render
+  // scene version) with r * r texels per face if any of them changed,
+  // return true if the map was regenerated
+  bool update(const triangle* tri, glm::vec3 l, int v, int r);
+  // force a rebuild at next update
+  void invalidate() { valid = false; }
+  // part of the 3x3 texels around p (on the triangle i) that see p,
+  // ndl is the cosine between the normal at p and the light (bias)
+  float visibility(glm::vec3 p, int i, float ndl) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_SHADOW_MAP_DEFINED__
@@ -0,0 +1,178 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT simd (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// 4 wide float vector, SSE when available and plain floats otherwise.
+
+#ifndef __MINIRT_SIMD_DEFINED__
+#define __MINIRT_SIMD_DEFINED__
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_IX86)
+#define MINIRT_SSE 1
+#include <emmintrin.h>
+#endif
+
+namespace miniRT {
+
+#ifdef MINIRT_SSE
+
+class float4 {
+ public:
+  __m128 v;
+  float4() {}
+  float4(__m128 in) : v(in) {}
+  float4(float f) : v(_mm_set1_ps(f)) {}
+  static float4 load(const float* p) { return _mm_loadu_ps(p); }
+  void store(float* p) const { _mm_storeu_ps(p, v); }
+  float operator[](int i) const {
+    float t[4];
+    store(t);
+    return t[i];
+  }
+  friend float4 operator+(float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+  friend float4 operator-(float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+  friend float4 operator*(float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+  friend float4 operator/(float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+  // comparisons return a lane mask
+  friend float4 operator<(float4 a, float4 b) {
+    return _mm_cmplt_ps(a.v, b.v);
+  }
+  friend float4 operator>(float4 a, float4 b) {
+    return _mm_cmpgt_ps(a.v, b.v);
+  }
+  friend float4 operator<=(float4 a, float4 b) {
+    return _mm_cmple_ps(a.v, b.v);
+  }
+  friend float4 operator>=(float4 a, float4 b) {
+    return _mm_cmpge_ps(a.v, b.v);
+  }
+  friend float4 operator&(float4 a, float4 b) { return _mm_and_ps(a.v, b.v); }
+  friend float4 operator|(float4 a, float4 b) { return _mm_or_ps(a.v, b.v); }
+  friend float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+  friend float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+  friend float4 sqrt(float4 a) { return _mm_sqrt_ps(a.v); }
+  // mask ? a : b
+  friend float4 select(float4 mask, float4 a, float4 b) {
+    return _mm_or_ps(_mm_and_ps(mask.v, a.v), _mm_andnot_ps(mask.v, b.v));
+  }
+  // one bit per lane
+  friend int movemask(float4 mask) { return _mm_movemask_ps(mask.v); }
+};
+
+#else  // MINIRT_SSE
+
+class float4 {
+  static float bits(bool b) {
+    union {
+      unsigned int i;
+      float f;
+    } u;
+    u.i = b ? 0xffffffff : 0;
+    return u.f;
+  }
+  static bool is_set(float f) {
+    union {
+      unsigned int i;
+      float f;
+    } u;
+    u.f = f;
+    return (u.i & 0x80000000) != 0;
+  }
+
+ public:
+  float v[4];
+  float4() {}
+  float4(float f) { v[0] = v[1] = v[2] = v[3] = f; }
+  static float4 load(const float* p) {
+    float4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = p[i];
+    return r;
+  }
+  void store(float* p) const {
+    for (int i = 0; i < 4; ++i) p[i] = v[i];
+  }
+  float operator[](int i) const { return v[i]; }
+#define MINIRT_FLOAT4_OP(OP, EXPR)                \
+  friend float4 OP(float4 a, float4 b) {          \
+    float4 r;                                     \
+    for (int i = 0; i < 4; ++i) r.v[i] = (EXPR);  \
+    return r;                                     \
+  }
+  MINIRT_FLOAT4_OP(operator+, a.v[i] + b.v[i])
+  MINIRT_FLOAT4_OP(operator-, a.v[i] - b.v[i])
+  MINIRT_FLOAT4_OP(operator*, a.v[i] * b.v[i])
+  MINIRT_FLOAT4_OP(operator/, a.v[i] / b.v[i])
+  MINIRT_FLOAT4_OP(operator<, bits(a.v[i] < b.v[i]))
+  MINIRT_FLOAT4_OP(operator>, bits(a.v[i] > b.v[i]))
+  MINIRT_FLOAT4_OP(operator<=, bits(a.v[i] <= b.v[i]))
+  MINIRT_FLOAT4_OP(operator>=, bits(a.v[i] >= b.v[i]))
+  MINIRT_FLOAT4_OP(operator&, bits(is_set(a.v[i]) && is_set(b.v[i])))
+  MINIRT_FLOAT4_OP(operator|, bits(is_set(a.v[i]) || is_set(b.v[i])))
+  MINIRT_FLOAT4_OP(min, a.v[i] < b.v[i] ? a.v[i] : b.v[i])
+  MINIRT_FLOAT4_OP(max, a.v[i] > b.v[i] ? a.v[i] : b.v[i])
+#undef MINIRT_FLOAT4_OP
+  friend float4 sqrt(float4 a) {
+    float4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = std::sqrt(a.v[i]);
+    return r;
+  }
+  friend float4 select(float4 mask, float4 a, float4 b) {
+    float4 r;
+    for (int i = 0; i < 4; ++i) r.v[i] = is_set(mask.v[i]) ? a.v[i] : b.v[i];
+    return r;
+  }
+  friend int movemask(float4 mask) {
+    int r = 0;
+    for (int i = 0; i < 4; ++i) r |= is_set(mask.v[i]) ? (1 << i) : 0;
+    return r;
+  }
+};
+
+#endif  // MINIRT_SSE
+
+// scale by 256, clamp to [0, 255], truncate and pack as 0x00bbggrr
+inline void pack_rgb(float4 r, float4 g, float4 b, unsigned int* out) {
+  const float4 scale(256.0f);
+  const float4 lo(0.0f);
+  const float4 hi(255.0f);
+  r = min(max(r * scale, lo), hi);
+  g = min(max(g * scale, lo), hi);
+  b = min(max(b * scale, lo), hi);
+#ifdef MINIRT_SSE
+  __m128i ir = _mm_cvttps_epi32(r.v);
+  __m128i ig = _mm_slli_epi32(_mm_cvttps_epi32(g.v), 8);
+  __m128i ib = _mm_slli_epi32(_mm_cvttps_epi32(b.v), 16);
+  _mm_storeu_si128((__m128i*)out, _mm_or_si128(ir, _mm_or_si128(ig, ib)));
+#else
+  for (int i = 0; i < 4; ++i)
+    out[i] = ((unsigned int)b[i] << 16) + ((unsigned int)g[i] << 8) +
+             (unsigned int)r[i];
+#endif  // MINIRT_SSE
+}
+
+// rows to columns (4 RGBA pixels to RRRR, GGGG, BBBB and AAAA)
+inline void transpose(float4& a, float4& b, float4& c, float4& d) {
+#ifdef MINIRT_SSE
+  _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+#else
+  float m[4][4];
+  a.store(m[0]);
+  b.store(m[1]);
+  c.store(m[2]);
+  d.store(m[3]);
+  for (int i = 0; i < 4; ++i) {
+    a.v[i] = m[i][0];
+    b.v[i] = m[i][1];
+    c.v[i] = m[i][2];
+    d.v[i] = m[i][3];
+  }
+#endif  // MINIRT_SSE
+}
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_SIMD_DEFINED__
@@ -0,0 +1,236 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT texture
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#include "miniRT_texture.h"
+
+#include <assert.h>
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+
+#include "miniRT_bc1.h"
+#include "miniRT_new.h"
+
+namespace miniRT {
+
+texture::texture()
+    : ptexel(0), pblock(0), ntexel(0), nlevel(0), pkey(0), pdecoded(0) {}
+
+bool texture::layout(int w, int h) {
+  if (!valid_size(w, h)) return false;
+  // level sizes and offsets (tiles are padded to 4x4)
+  ntexel = 0;
+  nlevel = 0;
+  for (int x = w, y = h;; x = std::max(x / 2, 1), y = std::max(y / 2, 1)) {
+    assert(nlevel < max_texture_levels);
+    lw[nlevel] = x;
+    lh[nlevel] = y;
+    ltx[nlevel] = (x + texture_tile - 1) / texture_tile;
+    lofs[nlevel] = ntexel;
+    ntexel += ltx[nlevel] * ((y + texture_tile - 1) / texture_tile) *
+              texture_tile * texture_tile;
+    ++nlevel;
+    if ((x == 1) && (y == 1)) break;
+  }
+  return true;
+}
+
+texture::texture(int w, int h, const unsigned int* rgba, bool compress)
+    : ptexel(0), pblock(0), ntexel(0), nlevel(0), pkey(0), pdecoded(0) {
+  assert(rgba);
+  assert(valid_size(w, h));
+  layout(w, h);
+  ptexel = new unsigned int[ntexel];
+  assert(ptexel);
+  for (int y = 0; y < h; ++y)
+    for (int x = 0; x < w; ++x) texel(0, x, y) = rgba[y * w + x];
+  // box filter of the level above
+  for (int l = 1; l < nlevel; ++l) {
+    int sx = lw[l - 1] / lw[l];
+    int sy = lh[l - 1] / lh[l];
+    for (int y = 0; y < lh[l]; ++y) {
+      for (int x = 0; x < lw[l]; ++x) {
+        unsigned int sum[3] = {0, 0, 0};
+        for (int j = 0; j < sy; ++j) {
+          for (int i = 0; i < sx; ++i) {
+            unsigned int t = texel(l - 1, x * sx + i, y * sy + j);
+            sum[0] += t & 0xff;
+            sum[1] += (t >> 8) & 0xff;
+            sum[2] += (t >> 16) & 0xff;
+          }
+        }
+        unsigned int n = sx * sy;
+        texel(l, x, y) = ((sum[2] + n / 2) / n << 16) +
+                         ((sum[1] + n / 2) / n << 8) + (sum[0] + n / 2) / n;
+      }
+    }
+  }
+  // repeat the levels smaller than a tile in the padding (compressed
+  // with the rest of the block)
+  for (int l = 0; l < nlevel; ++l) {
+    int tw = ltx[l] * texture_tile;
+    int th = (lh[l] + texture_tile - 1) / texture_tile * texture_tile;
+    for (int y = 0; y < th; ++y)
+      for (int x = (y < lh[l]) ? lw[l] : 0; x < tw; ++x)
+        texel(l, x, y) = texel(l, x & (lw[l] - 1), y & (lh[l] - 1));
+  }
+  if (!compress) return;
+  int nblock = ntexel / (texture_tile * texture_tile);
+  pblock = new unsigned int[nblock * bc1_block_size];
+  assert(pblock);
+  for (int b = 0; b < nblock; ++b)
+    bc1_encode(ptexel + b * texture_tile * texture_tile,
+               pblock + b * bc1_block_size);
+  delete[] ptexel;
+  ptexel = 0;
+  set_block_cache(true);
+}
+
+texture::~texture() {
+  if (ptexel) delete[] ptexel;
+  if (pblock) delete[] pblock;
+  if (pkey) delete[] pkey;
+  if (pdecoded) delete[] pdecoded;
+}
+
+texture* texture::load(const char* name) {
+  assert(name);
+  FILE* f = fopen(name, "rb");
+  if (!f) return 0;
+  char magic[4];
+  int size[2];
+  if ((fread(magic, 1, 4, f) != 4) || memcmp(magic, "BC1T", 4) ||
+      (fread(size, sizeof(int), 2, f) != 2) ||
+      !valid_size(size[0], size[1])) {
+    fclose(f);
+    return 0;
+  }
+  texture* t = new texture();
+  assert(t);
+  if (!t->layout(size[0], size[1])) {
+    fclose(f);
+    delete t;
+    return 0;
+  }
+  int n = t->ntexel / (texture_tile * texture_tile) * bc1_block_size;
+  t->pblock = new unsigned int[n];
+  assert(t->pblock);
+  bool ok = (fread(t->pblock, sizeof(unsigned int), n, f) == (size_t)n);
+  fclose(f);
+  if (!ok) {
+    delete t;
+    return 0;
+  }
+  t->set_block_cache(true);
+  return t;
+}
+
+bool texture::save(const char* name) const {
+  assert(name);
+  assert(pblock);
+  FILE* f = fopen(name, "wb");
+  if (!f) return false;
+  int size[2] = {lw[0], lh[0]};
+  int n = ntexel / (texture_tile * texture_tile) * bc1_block_size;
+  bool ok = (fwrite("BC1T", 1, 4, f) == 4) &&
+            (fwrite(size, sizeof(int), 2, f) == 2) &&
+            (fwrite(pblock, sizeof(unsigned int), n, f) == (size_t)n);
+  fclose(f);
+  return ok;
+}
+
+int texture::bytes() const {
+  if (pblock)
+    return ntexel / (texture_tile * texture_tile) * bc1_block_size *
+           (int)sizeof(unsigned int);
+  return ntexel * (int)sizeof(unsigned int);
+}
+
+void texture::set_block_cache(bool b) {
+  if (b && pblock && !pkey) {
+    pkey = new int[texture_cache_size];
+    pdecoded = new unsigned int[texture_cache_size * 16];
+    assert(pkey);
+    assert(pdecoded);
+    for (int i = 0; i < texture_cache_size; ++i) pkey[i] = -1;
+  } else if (!b && pkey) {
+    delete[] pkey;
+    delete[] pdecoded;
+    pkey = 0;
+    pdecoded = 0;
+  }
+}
+
+unsigned int texture::fetch(int l, int x, int y) const {
+  int t = ((y & 3) << 2) + (x & 3);
+  int i = tile(l, x, y);
+  if (!pblock) return ptexel[i + t];
+  int b = i / (texture_tile * texture_tile);
+  const unsigned int* pb = pblock + b * bc1_block_size;
+  if (!pkey) return bc1_texel(pb, t);
+  // direct mapped, the blocks of a row go to different entries
+  int s = b & (texture_cache_size - 1);
+  if (pkey[s] != b) {
+    bc1_decode(pb, pdecoded + s * 16);
+    pkey[s] = b;
+  }
+  return pdecoded[s * 16 + t];
+}
+
+float texture::lod(glm::vec2 duvdx, glm::vec2 duvdy) const {
+  glm::vec2 dx(duvdx.x * (float)lw[0], duvdx.y * (float)lh[0]);
+  glm::vec2 dy(duvdy.x * (float)lw[0], duvdy.y * (float)lh[0]);
+  float rho2 = std::max(glm::dot(dx, dx), glm::dot(dy, dy));
+  if (rho2 <= 1.0f) return 0.0f;
+  // log2 of the footprint in texels
+  return std::min(0.5f * log2f(rho2), (float)(nlevel - 1));
+}
+
+glm::vec3 texture::bilinear(glm::vec2 uv, int l) const {
+  assert((l >= 0) && (l < nlevel));
+  // texel centers are at half integers
+  float x = uv.x * (float)lw[l] - 0.5f;
+  float y = uv.y * (float)lh[l] - 0.5f;
+  float fx0 = floorf(x);
+  float fy0 = floorf(y);
+  float fx = x - fx0;
+  float fy = y - fy0;
+  // repeat (sizes are powers of 2)
+  int mx = lw[l] - 1;
+  int my = lh[l] - 1;
+  int x0 = (int)fx0 & mx;
+  int y0 = (int)fy0 & my;
+  int x1 = (x0 + 1) & mx;
+  int y1 = (y0 + 1) & my;
+  unsigned int t[4] = {fetch(l, x0, y0), fetch(l, x1, y0), fetch(l, x0, y1),
+                       fetch(l, x1, y1)};
+  float w[4] = {(1.0f - fx) * (1.0f - fy), fx * (1.0f - fy),
+                (1.0f - fx) * fy, fx * fy};
+  glm::vec3 c(0.0f);
+  for (int i = 0; i < 4; ++i)
+    c += glm::vec3((float)(t[i] & 0xff), (float)((t[i] >> 8) & 0xff),
+                   (float)((t[i] >> 16) & 0xff)) *
+         w[i];
+  return c * (1.0f / 255.0f);
+}
+
+glm::vec3 texture::sample(glm::vec2 uv, float lod) const {
+  return bilinear(uv, std::min((int)(lod + 0.5f), nlevel - 1));
+}
+
+glm::vec3 texture::trilinear(glm::vec2 uv, float lod) const {
+  int l = (int)lod;
+  float f = lod - (float)l;
+  if ((f == 0.0f) || (l + 1 >= nlevel)) return bilinear(uv, l);
+  return bilinear(uv, l) * (1.0f - f) + bilinear(uv, l + 1) * f;
+}
+
+}  // end namespace miniRT
@@ -0,0 +1,88 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT texture (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+// mip-mapped RGBA8 texture (power of 2 sizes, repeated). every level
+// is stored as 4x4 texel tiles (64 bytes) so that the 4 texels of a
+// bilinear fetch are in the same cache line most of the time. the
+// tiles can be compressed as BC1 blocks (8 bytes, see miniRT_bc1.h),
+// decoded at each fetch or through a small cache of decoded blocks.
+
+#ifndef __MINIRT_TEXTURE_DEFINED__
+#define __MINIRT_TEXTURE_DEFINED__
+
+#include <glm/glm.hpp>
+
+namespace miniRT {
+
+// side of a tile in texels
+const int texture_tile = 4;
+// up to 32768 x 32768
+const int max_texture_levels = 16;
+const int max_texture_size = 1 << (max_texture_levels - 1);
+// decoded blocks kept (direct mapped)
+const int texture_cache_size = 64;
+
+class texture {
+  // texels (uncompressed) or blocks (compressed)
+  unsigned int* ptexel;
+  unsigned int* pblock;
+  int ntexel;
+  int nlevel;
+  int lw[max_texture_levels];
+  int lh[max_texture_levels];
+  // first texel and tiles per row of each level
+  int lofs[max_texture_levels];
+  int ltx[max_texture_levels];
+  // block and texels of the cache entries (0 if no cache)
+  mutable int* pkey;
+  mutable unsigned int* pdecoded;
+  texture();
+  // false if the sizes are not valid
+  bool layout(int w, int h);
+  // first texel of the tile of (x, y) and texel in the tile
+  int tile(int l, int x, int y) const {
+    return lofs[l] + (((y >> 2) * ltx[l] + (x >> 2)) << 4);
+  }
+  unsigned int& texel(int l, int x, int y) const {
+    return ptexel[tile(l, x, y) + ((y & 3) << 2) + (x & 3)];
+  }
+  unsigned int fetch(int l, int x, int y) const;
+
+ public:
+  // w * h texels (powers of 2) as 0x00bbggrr from the first row, the
+  // mip levels are built from it and compressed if asked
+  texture(int w, int h, const unsigned int* rgba, bool compress = false);
+  ~texture();
+  // powers of 2 up to max_texture_size
+  static bool valid_size(int w, int h) {
+    return (w > 0) && (h > 0) && (w <= max_texture_size) &&
+           (h <= max_texture_size) && !(w & (w - 1)) && !(h & (h - 1));
+  }
+  // compressed textures file (see miniRT_bcenc), 0 if it failed
+  static texture* load(const char* name);
+  bool save(const char* name) const;
+  int width() const { return lw[0]; }
+  int height() const { return lh[0]; }
+  int levels() const { return nlevel; }
+  bool compressed() const { return pblock != 0; }
+  // storage used by the texels or the blocks
+  int bytes() const;
+  // decode the compressed blocks through a cache (default on)
+  void set_block_cache(bool b);
+  // level of detail from the derivatives of the texture coordinates
+  // over a pixel
+  float lod(glm::vec2 duvdx, glm::vec2 duvdy) const;
+  // 4 texels of the level l
+  glm::vec3 bilinear(glm::vec2 uv, int l) const;
+  // bilinear in the nearest level
+  glm::vec3 sample(glm::vec2 uv, float lod) const;
+  // bilinear in the 2 levels around lod
+  glm::vec3 trilinear(glm::vec2 uv, float lod) const;
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_TEXTURE_DEFINED__
@@ -0,0 +1,26 @@
+/////////////////////////////////////////////////////////////////////
+// miniRT tile (header)
+/////////////////////////////////////////////////////////////////////
+// author	: Dubouchet Frederic
+// e-mail	: angel@calodox.org
+/////////////////////////////////////////////////////////////////////
+
+#ifndef __MINIRT_TILE_DEFINED__
+#define __MINIRT_TILE_DEFINED__
+
+namespace miniRT {
+
+// size of a screen tile (in pixel)
+const int tile_size = 16;
+// number of consecutive triangles sharing a bounding box
+const int chunk_size = 16;
+
+// screen tile, pixels [x0, x1[ * [y0, y1[
+struct tile {
+  int x0, y0, x1, y1;
+  tile(int x, int y, int xe, int ye) : x0(x), y0(y), x1(xe), y1(ye) {}
+};
+
+}  // end namespace miniRT
+
+#endif  // __MINIRT_TILE_DEFINED__
@@ -9,7 +9,10 @@
 
 #include <glm/glm.hpp>
 
+#include "miniRT_index_buffer.h"
 #include "miniRT_new.h"
+#include "miniRT_packet.h"
+#include "miniRT_simd.h"
 #include "miniRT_vertex.h"
 #include "miniRT_vertex_buffer.h"
 
@@ -18,6 +21,34 @@ namespace miniRT {
 triangle::triangle(vertex_buffer* vb) {
   assert(vb);
   pvb = vb;
+  prec = 0;
+  nrec = 0;
+}
+
+triangle::~triangle() {
+  if (prec) delete[] prec;
+}
+
+void triangle::build(const index_buffer* ib) {
+  assert(pvb);
+  assert(ib);
+  assert(!(ib->size() % 3));
+  if (prec) delete[] prec;
+  nrec = ib->size() / 3;
+  prec = new tri_record[nrec];
+  assert(prec);
+  for (int i = 0; i < nrec; ++i) {
+    tri_record& r = prec[i];
+    for (int j = 0; j < 3; ++j) {
+      r.vi[j] = ib->get(i * 3 + j);
+      assert(r.vi[j] >= 0);
+      assert(r.vi[j] < pvb->size());
+    }
+    r.v0 = pvb->get_pos(r.vi[0]);
+    r.edge1 = (glm::vec3)pvb->get_pos(r.vi[1]) - r.v0;
+    r.edge2 = (glm::vec3)pvb->get_pos(r.vi[2]) - r.v0;
+    r.normal = glm::cross(r.edge1, r.edge2);
+  }
 }
 
 bool triangle::intersect_plane(const int v0, const int v1, const int v2,
@@ -168,6 +199,124 @@ bool triangle::intersect_barycentric(const int v0, const int v1, const int v2,
   return tuv->x > 0;
 }
 
+void triangle::setup_packet(const int v0, const int v1, const int v2,
+                            glm::vec3 o, packet_triangle* pt) {
+  assert(pvb);
+  assert(v0 >= 0);
+  assert(v0 < pvb->size());
+  assert(v1 >= 0);
+  assert(v1 < pvb->size());
+  assert(v2 >= 0);
+  assert(v2 < pvb->size());
+  assert(pt);
+
+  glm::vec3 p0 = (glm::vec3)pvb->get_pos(v0);
+  pt->edge1 = (glm::vec3)pvb->get_pos(v1) - p0;
+  pt->edge2 = (glm::vec3)pvb->get_pos(v2) - p0;
+  // the origin is the same for every ray so tvec, qvec and the t
+  // numerator are the same for the whole triangle
+  pt->tvec = o - p0;
+  pt->qvec = glm::cross(pt->tvec, pt->edge1);
+  pt->tnum = glm::dot(pt->edge2, pt->qvec);
+}
+
+int triangle::intersect_packet(const packet_triangle& pt, const ray_packet& rp,
+                               packet_hit* ph) {
+  assert(ph);
+
+  const float4 eps(std::numeric_limits<float>::epsilon());
+  const float4 zero(0.0f);
+  int mask = 0;
+  for (int r = 0; r < packet_dy; ++r) {
+    // pvec = cross(d, edge2)
+    float4 px = rp.dy[r] * pt.edge2.z - rp.dz[r] * pt.edge2.y;
+    float4 py = rp.dz[r] * pt.edge2.x - rp.dx[r] * pt.edge2.z;
+    float4 pz = rp.dx[r] * pt.edge2.y - rp.dy[r] * pt.edge2.x;
+    float4 det = px * pt.edge1.x + py * pt.edge1.y + pz * pt.edge1.z;
+    float4 u = px * pt.tvec.x + py * pt.tvec.y + pz * pt.tvec.z;
+    float4 v =
+        rp.dx[r] * pt.qvec.x + rp.dy[r] * pt.qvec.y + rp.dz[r] * pt.qvec.z;
+    float4 inv_det = float4(1.0f) / det;
+    float4 t = float4(pt.tnum) * inv_det;
+    float4 m = (det > eps) & (u >= zero - eps) & (u <= det) &
+               (v >= zero - eps) & (u + v <= det) & (t > zero);
+    ph->t[r] = t;
+    ph->u[r] = u * inv_det;
+    ph->v[r] = v * inv_det;
+    mask |= movemask(m) << (r * packet_dx);
+  }
+  ph->mask = mask;
+  return mask;
+}
+
+void triangle::intersect_det(const int i, glm::vec3 d, glm::vec4* pvd) {
+  assert(pvd);
+  const tri_record& r = get_record(i);
+  glm::vec3 pvec = glm::cross(d, r.edge2);
+  *pvd = glm::vec4(pvec, glm::dot(r.edge1, pvec));
+}
+
+bool triangle::intersect_barycentric(const int i, glm::vec4 pvd, glm::vec3 o,
+                                     glm::vec3 d, glm::vec4* tuv) {
+  assert(tuv);
+  const tri_record& r = get_record(i);
+  glm::vec3 pv = pvd;
+  float det = pvd.w;
+  assert(det > std::numeric_limits<float>::epsilon());
+
+  glm::vec3 tvec = o - r.v0;
+  tuv->y = glm::dot(tvec, pv);
+  if (tuv->y < -std::numeric_limits<float>::epsilon() || tuv->y > det)
+    return false;
+  glm::vec3 qvec = glm::cross(tvec, r.edge1);
+  tuv->z = glm::dot(d, qvec);
+  if (tuv->z < -std::numeric_limits<float>::epsilon() || tuv->z + tuv->y > det)
+    return false;
+  float inv_det = 1.0f / det;
+  tuv->x = glm::dot(r.edge2, qvec) * inv_det;
+  tuv->y *= inv_det;
+  tuv->z *= inv_det;
+  return tuv->x > 0;
+}
+
+bool triangle::shadow_hit(const int i, glm::vec3 o, glm::vec3 d,
+                          const float tmin, const float tmax) {
+  const tri_record& r = get_record(i);
+  // same as above with ABC = -edge1 and DEF = -edge2
+  glm::vec3 JKL = r.v0 - o;
+  glm::vec3 smat = glm::cross(d, r.edge2);
+  float inv_denom = 1.0f / glm::dot(r.edge1, smat);
+  float beta = glm::dot(JKL, smat) * -inv_denom;
+  if (beta <= 0.0f || beta >= 1.0f) return false;
+
+  smat = glm::cross(r.edge1, JKL);
+  float gamma = glm::dot(d, smat) * inv_denom;
+  if (gamma <= 0.0f || beta + gamma >= 1.0f) return false;
+
+  float tval = glm::dot(r.edge2, smat) * inv_denom;
+  return (tval >= tmin && tval <= tmax);
+}
+
+void triangle::setup_packet(const int i, glm::vec3 o, packet_triangle* pt) {
+  assert(pt);
+  const tri_record& r = get_record(i);
+  pt->edge1 = r.edge1;
+  pt->edge2 = r.edge2;
+  pt->tvec = o - r.v0;
+  pt->qvec = glm::cross(pt->tvec, pt->edge1);
+  pt->tnum = glm::dot(pt->edge2, pt->qvec);
+}
+
+glm::vec3 triangle::intersect_normal(const int i, glm::vec4 tuv) {
+  const tri_record& r = get_record(i);
+  return intersect_normal(r.vi[0], r.vi[1], r.vi[2], tuv);
+}
+
+glm::vec4 triangle::intersect_col(const int i, glm::vec4 tuv) {
+  const tri_record& r = get_record(i);
+  return intersect_col(r.vi[0], r.vi[1], r.vi[2], tuv);
+}
+
 glm::vec3 triangle::intersect_point(glm::vec4 tuv, glm::vec3 o, glm::vec3 d) {
   return o + d * tuv.x;
 }
@@ -199,9 +348,8 @@ glm::vec2 triangle::intersect_texmap(const int v0, const int v1, const int v2,
 
   // scaled texture coordinates
   float stc[6];
-  // CHECKME
   stc[0] = (1.0f - tuv.y - tuv.z) * pvb->get_UV(v0).x;
-  stc[1] = (1.0f - tuv.y - tuv.z) * pvb->get_UV(v0).x;
+  stc[1] = (1.0f - tuv.y - tuv.z) * pvb->get_UV(v0).y;
   stc[2] = tuv.y * pvb->get_UV(v1).x;
   stc[3] = tuv.y * pvb->get_UV(v1).y;
   stc[4] = tuv.z * pvb->get_UV(v2).x;
@@ -9,17 +9,47 @@
 #ifndef __MINIRT_TRIANGLE_DEFINED__
 #define __MINIRT_TRIANGLE_DEFINED__
 
+#include <assert.h>
+
 #include <glm/glm.hpp>
 
 namespace miniRT {
 
 class vertex_buffer;
+class index_buffer;
+struct ray_packet;
+struct packet_hit;
+struct packet_triangle;
+
+// intersection values of a triangle, precomputed once per scene so
+// the intersection only does one contiguous load
+struct tri_record {
+  glm::vec3 v0;
+  glm::vec3 edge1;
+  glm::vec3 edge2;
+  // geometric normal (edge1 x edge2)
+  glm::vec3 normal;
+  // vertex indices (for the shading attributes)
+  int vi[3];
+};
 
 class triangle {
   vertex_buffer* pvb;
+  tri_record* prec;
+  int nrec;
 
  public:
   triangle(vertex_buffer* vb);
+  ~triangle();
+
+  // build the records of the triangles of the index buffer
+  void build(const index_buffer* ib);
+  int size() const { return nrec; }
+  const tri_record& get_record(const int i) const {
+    assert(i >= 0);
+    assert(i < nrec);
+    return prec[i];
+  }
 
   bool intersect_plane(const int v0, const int v1, const int v2, glm::vec3 p,
                        glm::vec3 n);
@@ -39,6 +69,31 @@ class triangle {
                              glm::vec4 pvd, glm::vec3 o, glm::vec3 d,
                              glm::vec4* tuv);
 
+  // prepare the values shared by all the packets with origin o
+  void setup_packet(const int v0, const int v1, const int v2, glm::vec3 o,
+                    packet_triangle* pt);
+
+  // same test as intersect_det and intersect_barycentric for the 8 rays
+  // of the packet, return the mask of the lanes that hit
+  int intersect_packet(const packet_triangle& pt, const ray_packet& rp,
+                       packet_hit* ph);
+
+  // same as above on the triangle i records (see build), the
+  // determinant does not depend on the origin
+  void intersect_det(const int i, glm::vec3 d, glm::vec4* pvd);
+
+  bool intersect_barycentric(const int i, glm::vec4 pvd, glm::vec3 o,
+                             glm::vec3 d, glm::vec4* tuv);
+
+  bool shadow_hit(const int i, glm::vec3 o, glm::vec3 d, const float tmin,
+                  const float tmax);
+
+  void setup_packet(const int i, glm::vec3 o, packet_triangle* pt);
+
+  glm::vec3 intersect_normal(const int i, glm::vec4 tuv);
+
+  glm::vec4 intersect_col(const int i, glm::vec4 tuv);
+
   glm::vec3 intersect_point(glm::vec4 tuv, glm::vec3 o, glm::vec3 d);
 
   glm::vec3 intersect_normal(const int v0, const int v1, const int v2,
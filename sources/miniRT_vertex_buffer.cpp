@@ -18,6 +18,7 @@ namespace miniRT {
 vertex_buffer::vertex_buffer(size_t size) {
   assert(size > 0);
   nb = (int)size;
+  ver = 0;
   popt = new glm::vec3[size * 4];
   assert(popt);
 }
@@ -37,8 +38,10 @@ void vertex_buffer::set_optimized(const vertex* p) {
     pos += nb;
     memcpy(&popt[pos], &(p[i].rgba), sizeof(glm::vec3));
     pos += nb;
-    memcpy(&popt[pos], &(p[i].uv), sizeof(glm::vec3));
+    // uv is only 2 floats
+    popt[pos] = glm::vec3(p[i].uv, 0.0f);
   }
+  ++ver;
 }
 
 glm::vec3 vertex_buffer::get_pos(int i) {
@@ -18,6 +18,8 @@ class vertex_buffer {
   // optimized storage for vector
   glm::vec3* popt;
   int nb;
+  // incremented each time the datas change
+  int ver;
 
  public:
   // create and delete the buffer
@@ -27,6 +29,7 @@ class vertex_buffer {
   void set_optimized(const vertex* p);
   // get the values
   int size() const { return nb; }
+  int version() const { return ver; }
   glm::vec3 get_pos(int i);
   glm::vec3 get_normal(int i);
   glm::vec3 get_color(int i);